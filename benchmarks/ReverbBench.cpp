@@ -0,0 +1,1290 @@
+/*
+  ==============================================================================
+
+   Copyright 2023, 2024 Vitalii Voronkin
+
+   Reverb Project is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Reverb Project is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Simple Reverb. If not, see <http://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "ReverbFX.h"
+#include "ReverbFXBatch.h"
+#include "FDNReverb.h"
+#include "ConvolutionReverb.h"
+
+#include <iostream>
+#include <map>
+
+//==============================================================================
+/**
+    Drives the reverb engines directly, without a plugin host, and prints one line per
+    configuration as CSV (or JSON with --json).
+
+    Usage: ReverbBench [--seconds=2] [--repeats=3] [--engines=ReverbFX,juce::Reverb,FDN16,ReverbFXBatch8]
+                       [--sample-rates=44100,96000] [--block-sizes=64,512] [--json]
+                       [--tail-stress[=60]] [--verify]
+
+    --tail-stress feeds each engine one impulse followed by that many seconds of silence, with
+    the longest room, and prints the cost of every second of the tail as CSV. It runs without
+    ScopedNoDenormals, like a host that leaves the FPU alone, and exits with an error when any
+    second costs more than twice the first, which is what a tail sinking into denormals does.
+
+    --verify renders an impulse, noise and a sine sweep through a plain per-sample reference of
+    the ReverbFX network and through every optimised way of running it, in float and in double,
+    at each sample rate and block size (by default 44.1k, 48k and 96k, and 1, 61, 512 and 4096
+    samples). It prints the
+    largest difference in ULPs and in dB below the peak, and the RT60 and echo density of the
+    impulse responses, as CSV, and exits with an error when any variant is out of tolerance.
+*/
+namespace
+{
+    using Parameters = ReverbFX::Parameters;
+
+    enum class ParameterState
+    {
+        staticParams,
+        automating,
+        frozen
+    };
+
+    const char *getName(const ParameterState state)
+    {
+        switch (state)
+        {
+        case ParameterState::staticParams:
+            return "static";
+        case ParameterState::automating:
+            return "automating";
+        case ParameterState::frozen:
+            return "frozen";
+        }
+
+        return "";
+    }
+
+    /** Returns the parameters to use for a block, so automation moves them every block. */
+    Parameters getParametersForBlock(const ParameterState state, const int blockIndex)
+    {
+        Parameters params;
+
+        if (state == ParameterState::automating)
+        {
+            const auto phase = (float)blockIndex * 0.05f;
+            params.roomSize = 0.5f + 0.4f * std::sin(phase);
+            params.damping = 0.5f + 0.4f * std::cos(phase);
+            params.wetLevel = 0.5f + 0.3f * std::sin(phase * 0.7f);
+            params.dryLevel = 1.0f - params.wetLevel;
+            params.diffusionFeedback = 0.5f + 0.3f * std::cos(phase * 1.3f);
+        }
+        else if (state == ParameterState::frozen)
+        {
+            params.freezeMode = 1.0f;
+        }
+
+        return params;
+    }
+
+    //==============================================================================
+    /** Common face for every engine the benchmark can time. */
+    struct BenchEngine
+    {
+        virtual ~BenchEngine() = default;
+
+        virtual void prepare(double sampleRate) = 0;
+        virtual void setParameters(const Parameters &params) = 0;
+        virtual void processStereo(float *left, float *right, int numSamples) = 0;
+        virtual void processMono(float *samples, int numSamples) = 0;
+
+        /** How many reverbs one call processes; timings are reported per instance. */
+        virtual int getNumInstances() const { return 1; }
+
+        /** The rate the network runs at once prepared, if it differs from the host's. */
+        virtual double getNetworkSampleRate(const double sampleRate) const { return sampleRate; }
+    };
+
+    template <typename ReverbType>
+    struct EngineAdapter final : BenchEngine
+    {
+        void prepare(const double sampleRate) override
+        {
+            reverb.setSampleRate(sampleRate);
+            reverb.reset();
+        }
+
+        void setParameters(const Parameters &params) override
+        {
+            if constexpr (std::is_same_v<ReverbType, juce::Reverb>)
+            {
+                juce::Reverb::Parameters p;
+                p.roomSize = params.roomSize;
+                p.damping = params.damping;
+                p.wetLevel = params.wetLevel;
+                p.dryLevel = params.dryLevel;
+                p.width = params.width;
+                p.freezeMode = params.freezeMode;
+                reverb.setParameters(p);
+            }
+            else
+            {
+                reverb.setParameters(params);
+            }
+        }
+
+        void processStereo(float *const left, float *const right, const int numSamples) override
+        {
+            if constexpr (requires { reverb.processStereo(left, right, numSamples); })
+            {
+                reverb.processStereo(left, right, numSamples);
+            }
+            else
+            {
+                // a mono-only network runs on the left side, which the right then copies
+                reverb.processMono(left, numSamples);
+                juce::FloatVectorOperations::copy(right, left, numSamples);
+            }
+        }
+
+        void processMono(float *const samples, const int numSamples) override
+        {
+            reverb.processMono(samples, numSamples);
+        }
+
+        ReverbType reverb;
+    };
+
+    /** ReverbFX with its network running at a lower rate; see ReverbFX::setDownsampling. */
+    struct DownsampledAdapter final : BenchEngine
+    {
+        DownsampledAdapter() { reverb.setDownsampling(true); }
+
+        void prepare(const double sampleRate) override
+        {
+            reverb.setSampleRate(sampleRate);
+            reverb.reset();
+        }
+
+        void setParameters(const Parameters &params) override { reverb.setParameters(params); }
+
+        void processStereo(float *const left, float *const right, const int numSamples) override
+        {
+            reverb.processStereo(left, right, numSamples);
+        }
+
+        void processMono(float *const samples, const int numSamples) override
+        {
+            reverb.processMono(samples, numSamples);
+        }
+
+        double getNetworkSampleRate(double) const override { return reverb.getNetworkSampleRate(); }
+
+        ReverbFX reverb;
+    };
+
+    /** ReverbFX with its comb and diffusion delays modulated at full depth; see ReverbParameters. */
+    struct ModulatedAdapter final : BenchEngine
+    {
+        void prepare(const double sampleRate) override
+        {
+            reverb.setSampleRate(sampleRate);
+            reverb.reset();
+        }
+
+        void setParameters(const Parameters &params) override
+        {
+            auto modulated = params;
+            modulated.modulationDepth = 1.0f;
+            reverb.setParameters(modulated);
+        }
+
+        void processStereo(float *const left, float *const right, const int numSamples) override
+        {
+            reverb.processStereo(left, right, numSamples);
+        }
+
+        void processMono(float *const samples, const int numSamples) override
+        {
+            reverb.processMono(samples, numSamples);
+        }
+
+        ReverbFX reverb;
+    };
+
+    /** ReverbFX with its early reflections at full level; without diffusion, the whole wet share
+        goes to the combs and the diffusion filters rest. See EarlyReflections.
+    */
+    template <bool WithDiffusion>
+    struct EarlyReflectionsAdapter final : BenchEngine
+    {
+        void prepare(const double sampleRate) override
+        {
+            reverb.setSampleRate(sampleRate);
+            reverb.reset();
+        }
+
+        void setParameters(const Parameters &params) override
+        {
+            auto early = params;
+            early.earlyLevel = 1.0f;
+
+            if (!WithDiffusion)
+                early.diffusionFeedback = 1.0f;
+
+            reverb.setParameters(early);
+        }
+
+        void processStereo(float *const left, float *const right, const int numSamples) override
+        {
+            reverb.processStereo(left, right, numSamples);
+        }
+
+        void processMono(float *const samples, const int numSamples) override
+        {
+            reverb.processMono(samples, numSamples);
+        }
+
+        ReverbFX reverb;
+    };
+
+    /** ReverbFX with every channel of a delay line interleaved; see ReverbFX::setInterleavedChannels. */
+    struct InterleavedAdapter final : BenchEngine
+    {
+        InterleavedAdapter() { reverb.setInterleavedChannels(true); }
+
+        void prepare(const double sampleRate) override
+        {
+            reverb.setSampleRate(sampleRate);
+            reverb.reset();
+        }
+
+        void setParameters(const Parameters &params) override { reverb.setParameters(params); }
+
+        void processStereo(float *const left, float *const right, const int numSamples) override
+        {
+            reverb.processStereo(left, right, numSamples);
+        }
+
+        void processMono(float *const samples, const int numSamples) override
+        {
+            reverb.processMono(samples, numSamples);
+        }
+
+        ReverbFX reverb;
+    };
+
+    /** Feeds a reverb double buffers, as a host with a 64-bit mix engine does. The bench works in
+        float, so the conversions either side are timed too.
+    */
+    template <typename ReverbType>
+    struct DoubleAdapter final : BenchEngine
+    {
+        void prepare(const double sampleRate) override
+        {
+            reverb.setSampleRate(sampleRate);
+            reverb.reset();
+        }
+
+        void setParameters(const Parameters &params) override { reverb.setParameters(params); }
+
+        void processStereo(float *const left, float *const right, const int numSamples) override
+        {
+            buffer.setSize(2, numSamples, false, false, true);
+            convert(buffer.getWritePointer(0), left, numSamples);
+            convert(buffer.getWritePointer(1), right, numSamples);
+
+            reverb.processStereo(buffer.getWritePointer(0), buffer.getWritePointer(1), numSamples);
+
+            convert(left, buffer.getReadPointer(0), numSamples);
+            convert(right, buffer.getReadPointer(1), numSamples);
+        }
+
+        void processMono(float *const samples, const int numSamples) override
+        {
+            buffer.setSize(1, numSamples, false, false, true);
+            convert(buffer.getWritePointer(0), samples, numSamples);
+            reverb.processMono(buffer.getWritePointer(0), numSamples);
+            convert(samples, buffer.getReadPointer(0), numSamples);
+        }
+
+        template <typename Destination, typename Source>
+        static void convert(Destination *const destination, const Source *const source, const int numSamples)
+        {
+            for (int i = 0; i < numSamples; ++i)
+                destination[i] = (Destination)source[i];
+        }
+
+        ReverbType reverb;
+        juce::AudioBuffer<double> buffer;
+    };
+
+    /** ReverbFX on a send bus: wet only, and reading the bus into separate return buffers. The
+        bench processes in place, so the copy of the return back into the bus is timed too. With
+        MonoSend the bus is summed to one channel first, as a mono aux send would be.
+    */
+    template <bool MonoSend>
+    struct SendAdapter final : BenchEngine
+    {
+        SendAdapter() { reverb.setWetOnly(true); }
+
+        void prepare(const double sampleRate) override
+        {
+            reverb.setSampleRate(sampleRate);
+            reverb.reset();
+        }
+
+        void setParameters(const Parameters &params) override { reverb.setParameters(params); }
+
+        void processStereo(float *const left, float *const right, const int numSamples) override
+        {
+            returns.setSize(2, numSamples, false, false, true);
+
+            if constexpr (MonoSend)
+            {
+                send.setSize(1, numSamples, false, false, true);
+                juce::FloatVectorOperations::add(send.getWritePointer(0), left, right, numSamples);
+                reverb.process(send.getReadPointer(0), nullptr, returns.getWritePointer(0), returns.getWritePointer(1), numSamples);
+            }
+            else
+            {
+                reverb.process(left, right, returns.getWritePointer(0), returns.getWritePointer(1), numSamples);
+            }
+
+            juce::FloatVectorOperations::copy(left, returns.getReadPointer(0), numSamples);
+            juce::FloatVectorOperations::copy(right, returns.getReadPointer(1), numSamples);
+        }
+
+        void processMono(float *const samples, const int numSamples) override
+        {
+            returns.setSize(1, numSamples, false, false, true);
+            reverb.processMono(samples, returns.getWritePointer(0), numSamples);
+            juce::FloatVectorOperations::copy(samples, returns.getReadPointer(0), numSamples);
+        }
+
+        ReverbFX reverb;
+        juce::AudioBuffer<float> send, returns;
+    };
+
+    /** Runs ConvolutionReverb on a decaying noise response of the given length. */
+    template <int Seconds>
+    struct ConvolutionAdapter final : BenchEngine
+    {
+        void prepare(const double sampleRate) override
+        {
+            reverb.setMaximumLength(Seconds);
+            reverb.setSampleRate(sampleRate);
+
+            juce::AudioBuffer<float> response(2, (int)(Seconds * sampleRate));
+            juce::Random random(0x1e5);
+
+            for (int ch = 0; ch < response.getNumChannels(); ++ch)
+                for (int i = 0; i < response.getNumSamples(); ++i)
+                    response.setSample(ch, i, (random.nextFloat() * 2.0f - 1.0f) * std::exp(-6.9f * (float)i / response.getNumSamples()));
+
+            auto ir = reverb.prepareImpulseResponse(response, sampleRate);
+            reverb.allocateHistoryFor(*ir);
+            reverb.setImpulseResponse(std::move(ir));
+        }
+
+        void setParameters(const Parameters &params) override { reverb.setParameters(params); }
+
+        void processStereo(float *const left, float *const right, const int numSamples) override
+        {
+            reverb.processStereo(left, right, numSamples);
+        }
+
+        void processMono(float *const samples, const int numSamples) override
+        {
+            reverb.processMono(samples, numSamples);
+        }
+
+        ConvolutionReverb reverb;
+    };
+
+    /** Keeps every lane of a ReverbFXBatch busy with a copy of the same signal. */
+    template <int NumLanes>
+    struct BatchAdapter final : BenchEngine
+    {
+        void prepare(const double sampleRate) override
+        {
+            reverb.setSampleRate(sampleRate);
+
+            for (int lane = 0; lane < NumLanes; ++lane)
+                reverb.removeLane(lane);
+
+            for (int lane = 0; lane < NumLanes; ++lane)
+                reverb.addLane({});
+        }
+
+        void setParameters(const Parameters &params) override
+        {
+            for (int lane = 0; lane < NumLanes; ++lane)
+                reverb.setLaneParameters(lane, params);
+        }
+
+        void processStereo(float *const left, float *const right, const int numSamples) override
+        {
+            lanes.setSize(2 * NumLanes, numSamples, false, false, true);
+
+            float *leftLanes[NumLanes];
+            float *rightLanes[NumLanes];
+
+            for (int lane = 0; lane < NumLanes; ++lane)
+            {
+                lanes.copyFrom(2 * lane, 0, left, numSamples);
+                lanes.copyFrom(2 * lane + 1, 0, right, numSamples);
+                leftLanes[lane] = lanes.getWritePointer(2 * lane);
+                rightLanes[lane] = lanes.getWritePointer(2 * lane + 1);
+            }
+
+            reverb.processStereo(leftLanes, rightLanes, numSamples);
+
+            juce::FloatVectorOperations::copy(left, leftLanes[0], numSamples);
+            juce::FloatVectorOperations::copy(right, rightLanes[0], numSamples);
+        }
+
+        void processMono(float *const samples, const int numSamples) override
+        {
+            // the batch has no mono path, so a mono source is fed to both sides
+            processStereo(samples, samples, numSamples);
+        }
+
+        int getNumInstances() const override { return NumLanes; }
+
+        ReverbFXBatch<NumLanes> reverb;
+        juce::AudioBuffer<float> lanes;
+    };
+
+    struct EngineInfo
+    {
+        const char *name;
+        std::unique_ptr<BenchEngine> (*create)();
+    };
+
+    const EngineInfo engines[]{
+        {"ReverbFX", []() -> std::unique_ptr<BenchEngine> { return std::make_unique<EngineAdapter<ReverbFX>>(); }},
+        {"ReverbFXDownsampled", []() -> std::unique_ptr<BenchEngine> { return std::make_unique<DownsampledAdapter>(); }},
+        {"ReverbFXModulated", []() -> std::unique_ptr<BenchEngine> { return std::make_unique<ModulatedAdapter>(); }},
+        {"ReverbFXEarly", []() -> std::unique_ptr<BenchEngine> { return std::make_unique<EarlyReflectionsAdapter<true>>(); }},
+        {"ReverbFXEarlyNoDiffusion", []() -> std::unique_ptr<BenchEngine> { return std::make_unique<EarlyReflectionsAdapter<false>>(); }},
+        {"ReverbFXInterleaved", []() -> std::unique_ptr<BenchEngine> { return std::make_unique<InterleavedAdapter>(); }},
+        {"ReverbFXDoubleIO", []() -> std::unique_ptr<BenchEngine> { return std::make_unique<DoubleAdapter<ReverbFX>>(); }},
+        {"ReverbFXDoubleStorage", []() -> std::unique_ptr<BenchEngine> { return std::make_unique<DoubleAdapter<BasicReverbFX<2, StandardTopology, double>>>(); }},
+        {"ReverbFXSend", []() -> std::unique_ptr<BenchEngine> { return std::make_unique<SendAdapter<false>>(); }},
+        {"ReverbFXMonoSend", []() -> std::unique_ptr<BenchEngine> { return std::make_unique<SendAdapter<true>>(); }},
+        {"ReverbFXLight", []() -> std::unique_ptr<BenchEngine> { return std::make_unique<EngineAdapter<BasicReverbFX<2, LightTopology>>>(); }},
+        {"ReverbFXDense", []() -> std::unique_ptr<BenchEngine> { return std::make_unique<EngineAdapter<BasicReverbFX<2, DenseTopology>>>(); }},
+        {"MonoReverbFX", []() -> std::unique_ptr<BenchEngine> { return std::make_unique<EngineAdapter<MonoReverbFX>>(); }},
+        {"juce::Reverb", []() -> std::unique_ptr<BenchEngine> { return std::make_unique<EngineAdapter<juce::Reverb>>(); }},
+        {"FDN8", []() -> std::unique_ptr<BenchEngine> { return std::make_unique<EngineAdapter<FDNReverb<8>>>(); }},
+        {"FDN16", []() -> std::unique_ptr<BenchEngine> { return std::make_unique<EngineAdapter<FDNReverb<16>>>(); }},
+        {"FDN32", []() -> std::unique_ptr<BenchEngine> { return std::make_unique<EngineAdapter<FDNReverb<32>>>(); }},
+        {"Convolution1s", []() -> std::unique_ptr<BenchEngine> { return std::make_unique<ConvolutionAdapter<1>>(); }},
+        {"Convolution8s", []() -> std::unique_ptr<BenchEngine> { return std::make_unique<ConvolutionAdapter<8>>(); }},
+        {"ReverbFXBatch8", []() -> std::unique_ptr<BenchEngine> { return std::make_unique<BatchAdapter<8>>(); }},
+    };
+
+    //==============================================================================
+    struct Config
+    {
+        double seconds = 2.0;
+        int repeats = 3;
+        bool json = false;
+        juce::StringArray engineNames;
+        juce::Array<double> sampleRates{44100.0, 48000.0, 88200.0, 96000.0, 176400.0, 192000.0};
+        juce::Array<int> blockSizes{16, 32, 64, 128, 256, 512, 1024, 2048, 4096};
+        double tailStressSeconds = 0;
+        bool verify = false;
+    };
+
+    struct Result
+    {
+        juce::String engine, layout, state;
+        double sampleRate = 0;
+        int blockSize = 0;
+        double nsPerSample = 0;
+
+        /** How many instances one core could run in real time at this sample rate. */
+        double getInstancesPerCore() const { return 1.0e9 / (nsPerSample * sampleRate); }
+    };
+
+    /** Returns the fastest of several timed runs, in nanoseconds per sample frame and instance. */
+    double timeEngine(BenchEngine &engine, const Config &config, const double sampleRate,
+                      const int blockSize, const ParameterState state, const bool stereo)
+    {
+        const int numBlocks = juce::jmax(1, (int)(config.seconds * sampleRate) / blockSize);
+
+        juce::AudioBuffer<float> source(2, blockSize), buffer(2, blockSize);
+        juce::Random random(0x5eed);
+
+        for (int ch = 0; ch < source.getNumChannels(); ++ch)
+            for (int i = 0; i < blockSize; ++i)
+                source.setSample(ch, i, (random.nextFloat() * 2.0f - 1.0f) * 0.25f);
+
+        double best = std::numeric_limits<double>::max();
+
+        for (int repeat = 0; repeat < config.repeats; ++repeat)
+        {
+            juce::ScopedNoDenormals noDenormals;
+            engine.prepare(sampleRate);
+            engine.setParameters(getParametersForBlock(state, 0));
+
+            juce::int64 ticks = 0;
+
+            for (int block = 0; block < numBlocks; ++block)
+            {
+                for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+                    buffer.copyFrom(ch, 0, source, ch, 0, blockSize);
+
+                const auto start = juce::Time::getHighResolutionTicks();
+
+                if (state == ParameterState::automating)
+                    engine.setParameters(getParametersForBlock(state, block));
+
+                if (stereo)
+                    engine.processStereo(buffer.getWritePointer(0), buffer.getWritePointer(1), blockSize);
+                else
+                    engine.processMono(buffer.getWritePointer(0), blockSize);
+
+                ticks += juce::Time::getHighResolutionTicks() - start;
+            }
+
+            const auto seconds = juce::Time::highResolutionTicksToSeconds(ticks);
+            best = juce::jmin(best, seconds * 1.0e9 / ((double)numBlocks * blockSize * engine.getNumInstances()));
+        }
+
+        return best;
+    }
+
+    //==============================================================================
+    /** A second of the tail may cost this much more than the first before the stress test fails. */
+    constexpr double maximumTailCostRatio = 2.0;
+
+    /** Times an impulse and the silence after it, one second of the tail at a time. Prints a CSV
+        line per second and returns false if the cost rose past maximumTailCostRatio.
+    */
+    bool runTailStress(BenchEngine &engine, const char *name, const double seconds,
+                       const double sampleRate, const int blockSize)
+    {
+        Parameters params;
+        params.roomSize = 1.0f;
+        params.wetLevel = 1.0f;
+        params.dryLevel = 0.0f;
+
+        engine.prepare(sampleRate);
+        engine.setParameters(params);
+
+        juce::AudioBuffer<float> buffer(2, blockSize);
+        const int blocksPerSecond = juce::jmax(1, (int)(sampleRate / blockSize));
+        const int numSeconds = juce::jmax(1, (int)seconds);
+        double firstSecondNs = 0;
+        bool passed = true;
+
+        for (int second = 0; second < numSeconds; ++second)
+        {
+            juce::int64 ticks = 0, worstTicks = 0;
+
+            for (int block = 0; block < blocksPerSecond; ++block)
+            {
+                buffer.clear();
+
+                if (second == 0 && block == 0)
+                {
+                    buffer.setSample(0, 0, 1.0f);
+                    buffer.setSample(1, 0, 1.0f);
+                }
+
+                const auto start = juce::Time::getHighResolutionTicks();
+                engine.processStereo(buffer.getWritePointer(0), buffer.getWritePointer(1), blockSize);
+                const auto elapsed = juce::Time::getHighResolutionTicks() - start;
+
+                ticks += elapsed;
+                worstTicks = juce::jmax(worstTicks, elapsed);
+            }
+
+            const auto nsPerSample = juce::Time::highResolutionTicksToSeconds(ticks) * 1.0e9
+                                     / ((double)blocksPerSecond * blockSize * engine.getNumInstances());
+            const auto worstBlockNs = juce::Time::highResolutionTicksToSeconds(worstTicks) * 1.0e9;
+
+            if (second == 0)
+                firstSecondNs = nsPerSample;
+
+            const bool spiked = nsPerSample > firstSecondNs * maximumTailCostRatio;
+            passed = passed && !spiked;
+
+            std::cout << name << "," << sampleRate << "," << blockSize << "," << second << ","
+                      << nsPerSample << "," << worstBlockNs << (spiked ? ",spike" : ",ok") << "\n";
+        }
+
+        return passed;
+    }
+
+    //==============================================================================
+    /** A plain per-sample rendition of ReverbFX's network on constant parameters, written for
+        clarity rather than speed. The optimised engines are checked against it by --verify.
+    */
+    class ReferenceReverb
+    {
+    public:
+        ReferenceReverb(const int numChannels, const double sampleRate, const Parameters &params)
+            : coefficients(ReverbFX::getCoefficients(params)), channels((size_t)numChannels)
+        {
+            using Tunings = ReverbFX::Tunings;
+
+            for (int c = 0; c < numChannels; ++c)
+            {
+                auto &channel = channels[(size_t)c];
+                const int spread = c * Tunings::stereoSpread;
+
+                for (auto length : Tunings::combs)
+                    channel.combs.emplace_back(Tunings::scale(length + spread, sampleRate));
+
+                for (auto length : Tunings::allPasses)
+                    channel.allPasses.emplace_back(Tunings::scale(length + spread, sampleRate));
+
+                for (auto length : Tunings::diffusion)
+                    channel.diffusion.emplace_back(Tunings::scale(length + spread, sampleRate));
+
+                channel.combState.resize(channel.combs.size());
+            }
+        }
+
+        void processStereo(float *const left, float *const right, const int numSamples)
+        {
+            jassert(channels.size() == 2);
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const float input = (left[i] + right[i]) * coefficients.inputGain;
+                const float wetL = processChannel(channels[0], input);
+                const float wetR = processChannel(channels[1], input);
+
+                left[i] = wetL * coefficients.wetGain1 + wetR * coefficients.wetGain2 + left[i] * coefficients.dryGain;
+                right[i] = wetR * coefficients.wetGain1 + wetL * coefficients.wetGain2 + right[i] * coefficients.dryGain;
+            }
+        }
+
+        void processMono(float *const samples, const int numSamples)
+        {
+            const float foldGain = 1.0f / std::sqrt((float)channels.size());
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const float input = samples[i] * coefficients.inputGain;
+                float wet = 0;
+
+                for (auto &channel : channels)
+                    wet += processChannel(channel, input);
+
+                samples[i] = wet * ((coefficients.wetGain1 + coefficients.wetGain2) * foldGain) + samples[i] * coefficients.dryGain;
+            }
+        }
+
+    private:
+        /** Hands back what was written length samples ago, then stores a new sample in its place. */
+        struct DelayLine
+        {
+            explicit DelayLine(const int length) : buffer((size_t)length) {}
+
+            float read() const { return buffer[index]; }
+
+            void write(const float sample)
+            {
+                buffer[index] = sample;
+                index = (index + 1) % buffer.size();
+            }
+
+            std::vector<float> buffer;
+            size_t index = 0;
+        };
+
+        struct Channel
+        {
+            std::vector<DelayLine> combs, allPasses, diffusion;
+            std::vector<float> combState;
+        };
+
+        float processChannel(Channel &channel, const float input)
+        {
+            using Tunings = ReverbFX::Tunings;
+            float combOut = 0;
+
+            for (size_t i = 0; i < channel.combs.size(); ++i)
+            {
+                const float out = channel.combs[i].read();
+                channel.combState[i] = out * (1.0f - coefficients.damping) + channel.combState[i] * coefficients.damping;
+                channel.combs[i].write(channel.combState[i] * coefficients.feedback + input);
+                combOut += out;
+            }
+
+            for (auto &allPass : channel.allPasses)
+            {
+                const float buffered = allPass.read();
+                allPass.write(combOut + buffered * 0.5f);
+                combOut = buffered - combOut;
+            }
+
+            float diffusionOut = 0;
+
+            for (auto &line : channel.diffusion)
+            {
+                const float out = line.read();
+                line.write(input + out * Tunings::diffusionFeedbackLevel);
+                diffusionOut += out;
+            }
+
+            return combOut * (coefficients.combWeight * Tunings::combGain)
+                 + diffusionOut * ((1 - coefficients.combWeight) * Tunings::diffusionGain);
+        }
+
+        const ReverbFX::Coefficients coefficients;
+        std::vector<Channel> channels;
+    };
+
+    //==============================================================================
+    enum class TestSignal
+    {
+        impulse,
+        noise,
+        sweep
+    };
+
+    const char *getName(const TestSignal signal)
+    {
+        switch (signal)
+        {
+        case TestSignal::impulse:
+            return "impulse";
+        case TestSignal::noise:
+            return "noise";
+        case TestSignal::sweep:
+            return "sweep";
+        }
+
+        return "";
+    }
+
+    /** Long enough for the longest test room to fall 35 dB. */
+    constexpr double verifySeconds = 4.0;
+
+    /** The signal starts with a second of excitation, or a single impulse, and then falls silent. */
+    juce::AudioBuffer<float> makeTestSignal(const TestSignal signal, const double sampleRate)
+    {
+        juce::AudioBuffer<float> buffer(2, (int)(verifySeconds * sampleRate));
+        buffer.clear();
+
+        const int excitationLength = (int)sampleRate;
+        juce::Random random(0x5eed);
+
+        for (int i = 0; i < excitationLength; ++i)
+        {
+            if (signal == TestSignal::noise)
+            {
+                buffer.setSample(0, i, (random.nextFloat() * 2.0f - 1.0f) * 0.25f);
+                buffer.setSample(1, i, (random.nextFloat() * 2.0f - 1.0f) * 0.25f);
+            }
+            else if (signal == TestSignal::sweep)
+            {
+                // exponential from 20 Hz to 20 kHz, the same on both sides
+                const double ratio = std::log(1000.0), seconds = (double)i / sampleRate;
+                const double phase = juce::MathConstants<double>::twoPi * 20.0 * (std::exp(seconds * ratio) - 1.0) / ratio;
+                buffer.setSample(0, i, 0.5f * (float)std::sin(phase));
+                buffer.setSample(1, i, 0.5f * (float)std::sin(phase));
+            }
+        }
+
+        if (signal == TestSignal::impulse)
+        {
+            buffer.setSample(0, 0, 1.0f);
+            buffer.setSample(1, 0, 1.0f);
+        }
+
+        return buffer;
+    }
+
+    /** Runs a signal through an engine in blocks of the given size, after enough silence for the
+        parameter ramps from the engine's defaults to finish, so every engine starts from the same
+        constant parameters. A mono render only uses the first channel.
+    */
+    juce::AudioBuffer<float> render(BenchEngine &engine, const juce::AudioBuffer<float> &signal, const double sampleRate,
+                                    const int blockSize, const Parameters &params, const bool stereo)
+    {
+        engine.prepare(sampleRate);
+        engine.setParameters(params);
+
+        juce::AudioBuffer<float> buffer(2, juce::jmax(signal.getNumSamples(), (int)(0.02 * sampleRate)));
+        buffer.clear();
+
+        auto process = [&](const int numSamples)
+        {
+            for (int start = 0; start < numSamples; start += blockSize)
+            {
+                const int length = juce::jmin(blockSize, numSamples - start);
+
+                if (stereo)
+                    engine.processStereo(buffer.getWritePointer(0, start), buffer.getWritePointer(1, start), length);
+                else
+                    engine.processMono(buffer.getWritePointer(0, start), length);
+            }
+        };
+
+        process((int)(0.02 * sampleRate));
+
+        buffer.makeCopyOf(signal);
+        process(buffer.getNumSamples());
+
+        if (!stereo)
+            buffer.setSize(1, buffer.getNumSamples(), true);
+
+        return buffer;
+    }
+
+    juce::AudioBuffer<float> renderReference(const juce::AudioBuffer<float> &signal, const double sampleRate,
+                                             const Parameters &params, const int numChannels, const bool stereo)
+    {
+        ReferenceReverb reference(numChannels, sampleRate, params);
+        juce::AudioBuffer<float> buffer;
+        buffer.makeCopyOf(signal);
+
+        if (stereo)
+        {
+            reference.processStereo(buffer.getWritePointer(0), buffer.getWritePointer(1), buffer.getNumSamples());
+        }
+        else
+        {
+            reference.processMono(buffer.getWritePointer(0), buffer.getNumSamples());
+            buffer.setSize(1, buffer.getNumSamples(), true);
+        }
+
+        return buffer;
+    }
+
+    //==============================================================================
+    /** Returns how many representable floats lie between two values, 0 when they are identical. */
+    juce::int64 getUlpDistance(const float a, const float b)
+    {
+        // maps the bit patterns onto a line that is ordered like the values
+        auto toOrdered = [](const float value)
+        {
+            juce::int32 bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return bits < 0 ? (juce::int64)std::numeric_limits<juce::int32>::min() - bits : (juce::int64)bits;
+        };
+
+        return std::abs(toOrdered(a) - toOrdered(b));
+    }
+
+    struct Difference
+    {
+        juce::int64 maxUlps = 0;
+        double errorDb = -std::numeric_limits<double>::infinity(); /**< Largest difference, relative to the peak. */
+    };
+
+    Difference compare(const juce::AudioBuffer<float> &output, const juce::AudioBuffer<float> &expected)
+    {
+        jassert(output.getNumChannels() == expected.getNumChannels() && output.getNumSamples() == expected.getNumSamples());
+
+        Difference difference;
+        float peak = 0, largestError = 0;
+
+        for (int ch = 0; ch < expected.getNumChannels(); ++ch)
+        {
+            for (int i = 0; i < expected.getNumSamples(); ++i)
+            {
+                const float a = output.getSample(ch, i), b = expected.getSample(ch, i);
+                difference.maxUlps = juce::jmax(difference.maxUlps, getUlpDistance(a, b));
+                largestError = juce::jmax(largestError, std::abs(a - b));
+                peak = juce::jmax(peak, std::abs(b));
+            }
+        }
+
+        if (largestError > 0)
+            difference.errorDb = juce::Decibels::gainToDecibels((double)largestError / (double)peak, -400.0);
+
+        return difference;
+    }
+
+    /** Returns the wet part of an output, which is what the decay measurements look at. */
+    juce::AudioBuffer<float> removeDry(const juce::AudioBuffer<float> &output, const juce::AudioBuffer<float> &input, const float dryGain)
+    {
+        juce::AudioBuffer<float> wet;
+        wet.makeCopyOf(output);
+
+        for (int ch = 0; ch < wet.getNumChannels(); ++ch)
+            for (int i = 0; i < wet.getNumSamples(); ++i)
+                wet.setSample(ch, i, wet.getSample(ch, i) - input.getSample(ch, i) * dryGain);
+
+        return wet;
+    }
+
+    /** Returns the RT60 of an impulse response from its Schroeder decay curve: the fall from -5 dB to
+        -35 dB, extrapolated to 60 dB, or from -5 dB to -25 dB if the response ends too soon.
+        Returns 0 if even that is not reached.
+    */
+    double measureRT60(const juce::AudioBuffer<float> &response, const double sampleRate)
+    {
+        std::vector<double> decay((size_t)response.getNumSamples());
+        double energy = 0;
+
+        for (int i = response.getNumSamples(); --i >= 0;)
+        {
+            for (int ch = 0; ch < response.getNumChannels(); ++ch)
+                energy += juce::square((double)response.getSample(ch, i));
+
+            decay[(size_t)i] = energy;
+        }
+
+        if (energy <= 0)
+            return 0;
+
+        auto findTime = [&decay, energy, sampleRate](const double levelDb)
+        {
+            const double threshold = energy * std::pow(10.0, levelDb / 10.0);
+
+            for (size_t i = 0; i < decay.size(); ++i)
+                if (decay[i] <= threshold)
+                    return (double)i / sampleRate;
+
+            return -1.0;
+        };
+
+        const double start = findTime(-5.0);
+
+        if (const double end = findTime(-35.0); end > 0)
+            return (end - start) * 2.0;
+
+        if (const double end = findTime(-25.0); end > 0)
+            return (end - start) * 3.0;
+
+        return 0;
+    }
+
+    /** Returns the normalised echo density of an impulse response, averaged over its early part: the
+        share of samples in each 20 ms window that stand out by more than one standard deviation,
+        over the share a Gaussian would have. It is about 1 once the echoes have merged into noise.
+    */
+    double measureEchoDensity(const juce::AudioBuffer<float> &response, const double sampleRate)
+    {
+        const int windowLength = (int)(0.02 * sampleRate);
+        const int first = (int)(0.05 * sampleRate), last = juce::jmin(response.getNumSamples(), (int)(0.5 * sampleRate));
+        const double gaussianShare = std::erfc(1.0 / std::sqrt(2.0));
+        double total = 0;
+        int numWindows = 0;
+
+        for (int start = first; start + windowLength <= last; start += windowLength / 2)
+        {
+            double power = 0;
+
+            for (int i = 0; i < windowLength; ++i)
+                power += juce::square((double)response.getSample(0, start + i));
+
+            const double deviation = std::sqrt(power / windowLength);
+            int outliers = 0;
+
+            for (int i = 0; i < windowLength; ++i)
+                outliers += std::abs((double)response.getSample(0, start + i)) > deviation ? 1 : 0;
+
+            total += (double)outliers / windowLength / gaussianShare;
+            ++numWindows;
+        }
+
+        return numWindows > 0 ? total / numWindows : 0;
+    }
+
+    //==============================================================================
+    /** One optimised way of running the network, checked against the reference or another variant. */
+    struct Variant
+    {
+        const char *name;
+        const char *engine;     /**< Name in the engines table. */
+        bool stereo;
+        int referenceChannels;  /**< Channels of the reference network, 0 to compare with another variant. */
+        const char *baseline;   /**< The variant compared with when referenceChannels is 0. */
+        juce::int64 maximumUlps; /**< Passes when the output is at most this far from the expected... */
+        double maximumErrorDb;  /**< ...or when no difference exceeds this level below its peak. */
+        double rt60Tolerance;   /**< Relative. */
+        double echoDensityTolerance;
+        bool wetOnly = false;   /**< Compared with the expected output less its dry signal. */
+    };
+
+    constexpr auto noErrorLimit = std::numeric_limits<double>::infinity();
+    constexpr auto exactOnly = -std::numeric_limits<double>::infinity();
+
+    // The comb bank sums its lanes in a different order than the reference, the batch reads its
+    // coefficients from ramps, and double I/O or storage rounds elsewhere, so those differ in the
+    // last bits. The send variants are wet only, so the dry signal is taken off the reference;
+    // a mono send bus adds up the same as the network input of a stereo one. Interleaving only
+    // moves memory around and must not change a bit. Downsampling changes the signal, so only the shape of the
+    // tail is compared, with the reference running at the same network rate.
+    const Variant variants[]{
+        {"ReverbFX", "ReverbFX", true, 2, nullptr, 0, -100.0, 0.01, 0.02},
+        {"ReverbFX mono", "ReverbFX", false, 2, nullptr, 0, -100.0, 0.01, 0.02},
+        {"MonoReverbFX", "MonoReverbFX", false, 1, nullptr, 0, -100.0, 0.01, 0.02},
+        {"ReverbFXBatch8", "ReverbFXBatch8", true, 2, nullptr, 0, -100.0, 0.01, 0.02},
+        {"ReverbFXInterleaved", "ReverbFXInterleaved", true, 0, "ReverbFX", 0, exactOnly, 0, 0},
+        {"ReverbFXDoubleIO", "ReverbFXDoubleIO", true, 2, nullptr, 0, -100.0, 0.01, 0.02},
+        {"ReverbFXDoubleIO mono", "ReverbFXDoubleIO", false, 2, nullptr, 0, -100.0, 0.01, 0.02},
+        {"ReverbFXDoubleStorage", "ReverbFXDoubleStorage", true, 2, nullptr, 0, -100.0, 0.01, 0.02},
+        {"ReverbFXSend", "ReverbFXSend", true, 2, nullptr, 0, -100.0, 0.01, 0.02, true},
+        {"ReverbFXSend mono", "ReverbFXSend", false, 2, nullptr, 0, -100.0, 0.01, 0.02, true},
+        {"ReverbFXMonoSend", "ReverbFXMonoSend", true, 2, nullptr, 0, -100.0, 0.01, 0.02, true},
+        {"ReverbFXDownsampled", "ReverbFXDownsampled", true, 2, nullptr, std::numeric_limits<juce::int64>::max(), noErrorLimit, 0.02, 0.03},
+    };
+
+    struct VerifyCase
+    {
+        const char *name;
+        Parameters params;
+    };
+
+    std::vector<VerifyCase> getVerifyCases()
+    {
+        Parameters large;
+        large.roomSize = 0.9f;
+        large.damping = 0.7f;
+        large.width = 0.5f;
+        large.wetLevel = 0.5f;
+        large.dryLevel = 0.2f;
+        large.diffusionFeedback = 0.3f;
+
+        return {{"default", Parameters()}, {"large", large}};
+    }
+
+    bool runVerify(const Config &config)
+    {
+        bool passed = true;
+        std::cout << "variant,params,signal,sampleRate,blockSize,maxUlps,errorDb,rt60,expectedRt60,echoDensity,expectedEchoDensity,result\n";
+
+        for (auto sampleRate : config.sampleRates)
+        {
+            for (auto &testCase : getVerifyCases())
+            {
+                for (auto signal : {TestSignal::impulse, TestSignal::noise, TestSignal::sweep})
+                {
+                    const auto input = makeTestSignal(signal, sampleRate);
+                    std::map<juce::String, juce::AudioBuffer<float>> rendered;
+
+                    for (auto blockSize : config.blockSizes)
+                    {
+                        for (auto &variant : variants)
+                        {
+                            if (!config.engineNames.isEmpty() && !config.engineNames.contains(variant.engine))
+                                continue;
+
+                            const auto *info = std::find_if(std::begin(engines), std::end(engines), [&variant](const EngineInfo &e)
+                                                            { return juce::String(e.name) == variant.engine; });
+                            jassert(info != std::end(engines));
+
+                            auto engine = info->create();
+                            auto output = render(*engine, input, sampleRate, blockSize, testCase.params, variant.stereo);
+                            juce::AudioBuffer<float> expected;
+
+                            if (variant.referenceChannels > 0)
+                                expected = renderReference(input, sampleRate, testCase.params, variant.referenceChannels, variant.stereo);
+                            else if (auto baseline = rendered.find(variant.baseline); baseline != rendered.end())
+                                expected = baseline->second;
+                            else
+                                continue; // the baseline was filtered out
+
+                            const auto dryGain = ReverbFX::getCoefficients(testCase.params).dryGain;
+
+                            if (variant.wetOnly)
+                                expected = removeDry(expected, input, dryGain);
+
+                            const auto difference = compare(output, expected);
+                            bool ok = difference.maxUlps <= variant.maximumUlps || difference.errorDb <= variant.maximumErrorDb;
+
+                            std::cout << variant.name << "," << testCase.name << "," << getName(signal) << ","
+                                      << sampleRate << "," << blockSize << "," << difference.maxUlps << "," << difference.errorDb;
+
+                            if (signal == TestSignal::impulse)
+                            {
+                                // echo density depends on the rate, so a network running at a lower rate
+                                // than the host's is measured against the reference at that rate
+                                const auto networkRate = engine->getNetworkSampleRate(sampleRate);
+                                const auto outputDryGain = variant.wetOnly ? 0.0f : dryGain;
+                                const auto tail = removeDry(output, input, outputDryGain);
+                                auto expectedTail = removeDry(expected, input, outputDryGain);
+
+                                if (networkRate != sampleRate)
+                                {
+                                    const auto networkInput = makeTestSignal(signal, networkRate);
+                                    expectedTail = removeDry(renderReference(networkInput, networkRate, testCase.params,
+                                                                             variant.referenceChannels, variant.stereo),
+                                                             networkInput, dryGain);
+                                }
+
+                                const auto rt60 = measureRT60(tail, sampleRate), expectedRt60 = measureRT60(expectedTail, networkRate);
+                                const auto density = measureEchoDensity(tail, sampleRate);
+                                const auto expectedDensity = measureEchoDensity(expectedTail, networkRate);
+
+                                ok = ok && std::abs(rt60 - expectedRt60) <= variant.rt60Tolerance * expectedRt60
+                                        && std::abs(density - expectedDensity) <= variant.echoDensityTolerance;
+
+                                std::cout << "," << rt60 << "," << expectedRt60 << "," << density << "," << expectedDensity;
+                            }
+                            else
+                            {
+                                std::cout << ",,,,";
+                            }
+
+                            std::cout << (ok ? ",ok" : ",FAIL") << "\n";
+                            passed = passed && ok;
+
+                            rendered[variant.name] = std::move(output);
+                        }
+                    }
+                }
+            }
+        }
+
+        return passed;
+    }
+
+    void printResult(const Result &result, const bool json, const bool first)
+    {
+        if (json)
+        {
+            std::cout << (first ? "[\n  " : ",\n  ")
+                      << "{\"engine\": \"" << result.engine << "\", \"layout\": \"" << result.layout
+                      << "\", \"state\": \"" << result.state << "\", \"sampleRate\": " << result.sampleRate
+                      << ", \"blockSize\": " << result.blockSize << ", \"nsPerSample\": " << result.nsPerSample
+                      << ", \"instancesPerCore\": " << result.getInstancesPerCore() << "}";
+        }
+        else
+        {
+            if (first)
+                std::cout << "engine,layout,state,sampleRate,blockSize,nsPerSample,instancesPerCore\n";
+
+            std::cout << result.engine << "," << result.layout << "," << result.state << ","
+                      << result.sampleRate << "," << result.blockSize << "," << result.nsPerSample << ","
+                      << result.getInstancesPerCore() << "\n";
+        }
+    }
+
+    Config parseArguments(const juce::ArgumentList &args)
+    {
+        Config config;
+
+        if (args.containsOption("--seconds"))
+            config.seconds = juce::jmax(0.01, args.getValueForOption("--seconds").getDoubleValue());
+
+        if (args.containsOption("--repeats"))
+            config.repeats = juce::jmax(1, args.getValueForOption("--repeats").getIntValue());
+
+        config.json = args.containsOption("--json");
+
+        if (args.containsOption("--tail-stress"))
+        {
+            const auto seconds = args.getValueForOption("--tail-stress").getDoubleValue();
+            config.tailStressSeconds = seconds > 0 ? seconds : 60.0;
+        }
+
+        if (args.containsOption("--verify"))
+        {
+            // every variant renders seconds of audio at each setting, so the grid is smaller
+            config.verify = true;
+            config.sampleRates = {44100.0, 48000.0, 96000.0};
+            config.blockSizes = {1, 61, 512, 4096};
+        }
+
+        if (args.containsOption("--engines"))
+            config.engineNames = juce::StringArray::fromTokens(args.getValueForOption("--engines"), ",", "");
+
+        if (args.containsOption("--sample-rates"))
+        {
+            config.sampleRates.clear();
+
+            for (auto &token : juce::StringArray::fromTokens(args.getValueForOption("--sample-rates"), ",", ""))
+                config.sampleRates.add(token.getDoubleValue());
+        }
+
+        if (args.containsOption("--block-sizes"))
+        {
+            config.blockSizes.clear();
+
+            for (auto &token : juce::StringArray::fromTokens(args.getValueForOption("--block-sizes"), ",", ""))
+                config.blockSizes.add(token.getIntValue());
+        }
+
+        return config;
+    }
+}
+
+//==============================================================================
+int main(int argc, char *argv[])
+{
+    const auto config = parseArguments(juce::ArgumentList(argc, argv));
+    const ParameterState states[]{ParameterState::staticParams, ParameterState::automating, ParameterState::frozen};
+    bool first = true;
+
+    if (config.verify)
+        return runVerify(config) ? 0 : 1;
+
+    if (config.tailStressSeconds > 0)
+    {
+        bool passed = true;
+        std::cout << "engine,sampleRate,blockSize,second,nsPerSample,worstBlockNs,result\n";
+
+        for (auto &info : engines)
+        {
+            if (!config.engineNames.isEmpty() && !config.engineNames.contains(info.name))
+                continue;
+
+            auto engine = info.create();
+
+            for (auto sampleRate : config.sampleRates)
+                for (auto blockSize : config.blockSizes)
+                    passed = runTailStress(*engine, info.name, config.tailStressSeconds, sampleRate, blockSize) && passed;
+        }
+
+        return passed ? 0 : 1;
+    }
+
+    for (auto &info : engines)
+    {
+        if (!config.engineNames.isEmpty() && !config.engineNames.contains(info.name))
+            continue;
+
+        auto engine = info.create();
+
+        for (auto sampleRate : config.sampleRates)
+        {
+            for (auto blockSize : config.blockSizes)
+            {
+                for (auto state : states)
+                {
+                    for (auto stereo : {true, false})
+                    {
+                        Result result;
+                        result.engine = info.name;
+                        result.layout = stereo ? "stereo" : "mono";
+                        result.state = getName(state);
+                        result.sampleRate = sampleRate;
+                        result.blockSize = blockSize;
+                        result.nsPerSample = timeEngine(*engine, config, sampleRate, blockSize, state, stereo);
+
+                        printResult(result, config.json, first);
+                        first = false;
+                    }
+                }
+            }
+        }
+    }
+
+    if (config.json)
+        std::cout << (first ? "[]\n" : "\n]\n");
+
+    return 0;
+}
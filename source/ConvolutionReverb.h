@@ -0,0 +1,766 @@
+/*
+  ==============================================================================
+
+   Copyright 2023, 2024 Vitalii Voronkin
+
+   Reverb Project is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Reverb Project is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Simple Reverb. If not, see <http://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "ReverbFX.h"
+
+//==============================================================================
+/**
+    Convolves the input with a measured impulse response, with no added latency.
+
+    The first headSize samples of the response are applied directly, sample by sample. The
+    rest is convolved in partitions through FFTs (overlap-save), in levels that start eight
+    times further into the response each: headSize-sample partitions up to 8 x headSize, then
+    8 x headSize ones up to 64 x headSize, and so on, with partitions of at most 8192 samples.
+    A level's partitions are never longer than its start, so its result, computed at the end
+    of each of its blocks, is never due before the next block.
+
+    Only the newest block of input has to wait for the end of a level's block; every older one
+    is already transformed. So the older blocks are multiplied with their partitions a share at
+    a time as samples come in, and the end of a level's block is left with its two transforms
+    and its first partition. At worst, n samples cost those for each level whose block ends
+    among them, plus (partitions - 1) x n / partition size + 1 partitions of each level. For
+    a 10 second response at 48kHz that is one partition of 8192 samples per level in a 64
+    sample block, rather than 51 of them all at once, so the peak cost of a block no longer
+    grows with the length of the response.
+
+    A bigger head costs more per sample, but needs fewer, larger FFTs for the rest.
+
+    Responses are prepared (resampled, normalised, transformed) with prepareImpulseResponse
+    on any thread but the audio thread, and handed over with setImpulseResponse. The audio
+    thread picks the new one up at its next block without allocating or freeing anything;
+    the one it replaces is freed by the next call to releaseRetiredImpulseResponses.
+
+    The input history is laid out for the response being played and no longer, so a reverb
+    that never gets one holds little more than its head. A response laid out differently
+    from the one before needs allocateHistoryFor first, while no processing is going on.
+
+    It takes the same Parameters as ReverbFX, but only the wet, dry and width settings
+    apply to a measured response.
+*/
+class ConvolutionReverb
+{
+private:
+    enum
+    {
+        numChannels = 2,
+        maximumLevels = 4,
+        levelGrowth = 8,
+        maximumPartitionSize = 8192
+    };
+
+public:
+    //==============================================================================
+    using Parameters = ReverbFX::Parameters;
+
+    /** A response ready for one sample rate and head size. */
+    class ImpulseResponse
+    {
+    public:
+        ImpulseResponse() = default;
+
+        /** Returns the length of the response in seconds, as it will be played. */
+        double getLengthInSeconds() const noexcept { return (double)length / sampleRate; }
+
+    private:
+        friend class ConvolutionReverb;
+
+        double sampleRate = 0;
+        int headSize = 0, numChannels = 0, length = 0, numLevels = 0;
+        int numPartitions[maximumLevels] = {};
+        int levelStarts[maximumLevels] = {};
+
+        HeapBlock<float> head;                       // per channel, headSize taps in reverse order
+        HeapBlock<float> partitions;                 // per level, channel and partition, a split-complex spectrum
+        size_t levelOffsets[maximumLevels] = {};     // where each level starts in partitions
+
+        JUCE_DECLARE_NON_COPYABLE(ImpulseResponse)
+    };
+
+    ConvolutionReverb()
+    {
+        setParameters(Parameters());
+        setSampleRate(44100.0);
+    }
+
+    ~ConvolutionReverb()
+    {
+        destroy(current);
+        destroy(pending.exchange(nullptr));
+        destroy(retired.exchange(nullptr));
+    }
+
+    //==============================================================================
+    /** Returns the reverb's current parameters. */
+    const Parameters &getParameters() const noexcept { return parameters; }
+
+    /** Applies a new set of parameters to the reverb.
+        As with ReverbFX, call this from the audio thread or between process calls.
+    */
+    void setParameters(const Parameters &newParams)
+    {
+        const auto coefficients = ReverbFX::getCoefficients(newParams);
+
+        dryGain.setTargetValue(coefficients.dryGain);
+        wetGain1.setTargetValue(coefficients.wetGain1);
+        wetGain2.setTargetValue(coefficients.wetGain2);
+
+        parameters = newParams;
+    }
+
+    //==============================================================================
+    /** Sets the sample rate that will be used for the reverb.
+        This allocates and drops the current response and its history, so the response then
+        has to be prepared again for the new rate. Call it while no processing or loading is
+        going on.
+    */
+    void setSampleRate(const double sampleRate)
+    {
+        jassert(sampleRate > 0);
+
+        currentSampleRate = sampleRate;
+        historyLength = 0;
+        allocate();
+
+        const double smoothTime = 0.01;
+        dryGain.reset(sampleRate, smoothTime);
+        wetGain1.reset(sampleRate, smoothTime);
+        wetGain2.reset(sampleRate, smoothTime);
+    }
+
+    /** Sets how many samples of the response are applied directly, as a power of two from 32
+        to 4096. Like setSampleRate, this allocates and drops the current response.
+    */
+    void setHeadSize(const int newHeadSize)
+    {
+        jassert(isPowerOfTwo(newHeadSize) && newHeadSize >= 32 && newHeadSize <= 4096);
+
+        headSize = jlimit(32, 4096, nextPowerOfTwo(newHeadSize));
+        historyLength = 0;
+        allocate();
+    }
+
+    int getHeadSize() const noexcept { return headSize; }
+
+    /** Sets the longest response that can be played. Longer ones are cut short when they are
+        prepared, so call it before preparing one.
+    */
+    void setMaximumLength(const double seconds)
+    {
+        jassert(seconds > 0);
+
+        maximumLengthSeconds = seconds;
+    }
+
+    //==============================================================================
+    /** Turns a response, at any sample rate, into one that can be played at the current
+        sample rate and head size. It is normalised to unit energy, so the mix sounds about
+        as loud as ReverbFX. Call it from any thread but the audio thread.
+    */
+    std::unique_ptr<ImpulseResponse> prepareImpulseResponse(const AudioBuffer<float> &source, const double sourceSampleRate) const
+    {
+        jassert(sourceSampleRate > 0);
+
+        const int numResponseChannels = jlimit(1, (int)numChannels, source.getNumChannels());
+        const double ratio = sourceSampleRate / currentSampleRate;
+        const int length = jlimit(1, getMaximumLengthInSamples(), (int)std::ceil(source.getNumSamples() / ratio));
+
+        auto ir = std::make_unique<ImpulseResponse>();
+        ir->sampleRate = currentSampleRate;
+        ir->headSize = headSize;
+        ir->numChannels = numResponseChannels;
+        ir->length = length;
+
+        int partitionSizes[maximumLevels];
+        ir->numLevels = layoutLevels(length, partitionSizes, ir->levelStarts, ir->numPartitions);
+
+        // resample, or just copy, into a buffer padded to whole partitions
+        int paddedLength = headSize, largestSize = headSize;
+
+        for (int level = 0; level < ir->numLevels; ++level)
+        {
+            paddedLength = jmax(paddedLength, ir->levelStarts[level] + ir->numPartitions[level] * partitionSizes[level]);
+            largestSize = jmax(largestSize, partitionSizes[level]);
+        }
+
+        AudioBuffer<float> response(numResponseChannels, paddedLength);
+        response.clear();
+
+        for (int ch = 0; ch < numResponseChannels; ++ch)
+        {
+            if (approximatelyEqual(ratio, 1.0))
+            {
+                response.copyFrom(ch, 0, source, ch, 0, jmin(length, source.getNumSamples()));
+            }
+            else
+            {
+                // the interpolator reads a few samples ahead, so it gets a zero-padded copy
+                AudioBuffer<float> padded(1, source.getNumSamples() + 8);
+                padded.clear();
+                padded.copyFrom(0, 0, source, ch, 0, source.getNumSamples());
+
+                LagrangeInterpolator interpolator;
+                interpolator.process(ratio, padded.getReadPointer(0), response.getWritePointer(ch), length);
+            }
+        }
+
+        double energy = 0;
+
+        for (int ch = 0; ch < numResponseChannels; ++ch)
+            for (int i = 0; i < length; ++i)
+                energy += (double)response.getSample(ch, i) * response.getSample(ch, i);
+
+        // the 1/3 undoes the wet scaling of ReverbFX::getCoefficients
+        const float normalisation = energy > 0 ? (float)(1.0 / (3.0 * std::sqrt(energy / numResponseChannels))) : 0.0f;
+
+        ir->head.allocate((size_t)(numResponseChannels * headSize), true);
+
+        for (int ch = 0; ch < numResponseChannels; ++ch)
+            for (int i = 0; i < headSize; ++i)
+                ir->head[ch * headSize + i] = response.getSample(ch, headSize - 1 - i) * normalisation;
+
+        size_t numFloats = 0;
+
+        for (int level = 0; level < ir->numLevels; ++level)
+        {
+            ir->levelOffsets[level] = numFloats;
+            numFloats += (size_t)(numResponseChannels * ir->numPartitions[level] * getSpectrumSize(partitionSizes[level]));
+        }
+
+        ir->partitions.allocate(numFloats, true);
+        HeapBlock<float> frame((size_t)(4 * largestSize), true);
+
+        for (int level = 0; level < ir->numLevels; ++level)
+        {
+            const int size = partitionSizes[level];
+            const int spectrumSize = getSpectrumSize(size);
+            dsp::FFT fft(getFFTOrder(size));
+
+            for (int ch = 0; ch < numResponseChannels; ++ch)
+            {
+                for (int p = 0; p < ir->numPartitions[level]; ++p)
+                {
+                    // the kernel sits in the first half of the FFT frame, as overlap-save needs
+                    FloatVectorOperations::clear(frame.get(), 4 * size);
+                    FloatVectorOperations::copyWithMultiply(frame.get(), response.getReadPointer(ch, ir->levelStarts[level] + p * size),
+                                                            normalisation, size);
+
+                    fft.performRealOnlyForwardTransform(frame, true);
+                    splitSpectrum(frame, ir->partitions + ir->levelOffsets[level] + (size_t)((ch * ir->numPartitions[level] + p) * spectrumSize), size);
+                }
+            }
+        }
+
+        return ir;
+    }
+
+    /** Returns true if the input history is laid out for a response, so that it can be handed
+        over without allocating anything.
+    */
+    bool hasHistoryFor(const ImpulseResponse &ir) const noexcept
+    {
+        if (ir.numLevels != numLevels)
+            return false;
+
+        for (int l = 0; l < numLevels; ++l)
+            if (ir.numPartitions[l] != levels[l].numPartitions)
+                return false;
+
+        return true;
+    }
+
+    /** Lays out the input history for a prepared response, and for nothing longer.
+        Like setSampleRate, this allocates and drops the current response, so call it while
+        no processing is going on, and then hand the response over with setImpulseResponse.
+    */
+    void allocateHistoryFor(const ImpulseResponse &ir)
+    {
+        jassert(approximatelyEqual(ir.sampleRate, currentSampleRate) && ir.headSize == headSize);
+
+        historyLength = ir.length;
+        allocate();
+    }
+
+    /** Hands a prepared response to the audio thread, which switches to it at its next block.
+        Returns false, and keeps the response out of use, if it was prepared for another
+        sample rate or head size, or if the history is not laid out for it; see hasHistoryFor.
+        Passing nullptr removes the response. Call it from any thread but the audio thread.
+    */
+    bool setImpulseResponse(std::unique_ptr<ImpulseResponse> ir)
+    {
+        if (ir != nullptr && (!approximatelyEqual(ir->sampleRate, currentSampleRate) || ir->headSize != headSize || !hasHistoryFor(*ir)))
+            return false;
+
+        releaseRetiredImpulseResponses();
+
+        // a response the audio thread never got round to picking up is simply replaced
+        destroy(pending.exchange(ir != nullptr ? ir.release() : &silence));
+        return true;
+    }
+
+    /** Frees the response the audio thread has finished with. Call it from any thread but
+        the audio thread.
+    */
+    void releaseRetiredImpulseResponses()
+    {
+        destroy(retired.exchange(nullptr));
+    }
+
+    /** Returns the length of the response being played, in seconds. Audio thread only. */
+    double getImpulseLengthSeconds() const noexcept { return current != nullptr ? current->getLengthInSeconds() : 0.0; }
+
+    //==============================================================================
+    /** Clears the reverb's buffers, so it can be called from the audio thread, as switching
+        engines does. The ring of input spectra, which makes up nearly all of the history, is
+        left as it is: each slot counts as silent until it has been written again.
+    */
+    void reset()
+    {
+        for (int l = 0; l < numLevels; ++l)
+        {
+            auto &level = levels[l];
+
+            for (int ch = 0; ch < numChannels; ++ch)
+            {
+                FloatVectorOperations::clear(level.window[ch], 2 * level.partitionSize);
+                FloatVectorOperations::clear(level.sum[ch], getSpectrumSize(level.partitionSize));
+            }
+
+            level.newestSlot = 0;
+            level.numFilled = 0;
+            level.nextPartition = 1;
+        }
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            FloatVectorOperations::clear(tailRing[ch], ringSize);
+            FloatVectorOperations::clear(headWindow[ch], 2 * headSize);
+        }
+
+        position = 0;
+    }
+
+    /** Returns the number of bytes this reverb has allocated, not counting its response. */
+    size_t getMemoryFootprint() const noexcept { return storageSize * sizeof(float); }
+
+    //==============================================================================
+    /** Applies the reverb to two stereo channels of audio data. */
+    void processStereo(float *const left, float *const right, const int numSamples) noexcept
+    {
+        jassert(left != nullptr && right != nullptr);
+
+        float *const channels[] = {left, right};
+        process(channels, numChannels, numSamples);
+    }
+
+    /** Applies the reverb to a single mono channel of audio data. */
+    void processMono(float *const samples, const int numSamples) noexcept
+    {
+        jassert(samples != nullptr);
+
+        float *const channels[] = {samples};
+        process(channels, 1, numSamples);
+    }
+
+private:
+    //==============================================================================
+    void destroy(ImpulseResponse *const ir) noexcept
+    {
+        if (ir != &silence)
+            delete ir;
+    }
+
+    static int getFFTOrder(const int partitionSize) noexcept { return 1 + roundToInt(std::log2(partitionSize)); }
+
+    /** Floats in one split-complex spectrum of partitionSize + 1 bins. */
+    static int getSpectrumSize(const int partitionSize) noexcept { return 2 * (partitionSize + 1); }
+
+    int getMaximumLengthInSamples() const noexcept
+    {
+        return jmax(headSize, (int)std::ceil(maximumLengthSeconds * currentSampleRate));
+    }
+
+    /** Works out the partition size, start and partition count of every level needed for a
+        response of numSamples, and returns the number of levels.
+    */
+    int layoutLevels(const int numSamples, int *const partitionSizes, int *const starts, int *const numPartitions) const noexcept
+    {
+        int numLevels = 0;
+
+        for (int start = headSize; start < numSamples; start *= levelGrowth)
+        {
+            const int size = jmin(start, (int)maximumPartitionSize);
+            const int nextStart = start * levelGrowth;
+            const bool isLast = numLevels == maximumLevels - 1 || size == maximumPartitionSize || numSamples <= nextStart;
+
+            partitionSizes[numLevels] = size;
+            starts[numLevels] = start;
+            numPartitions[numLevels] = isLast ? (numSamples - start + size - 1) / size : (nextStart - start) / size;
+            ++numLevels;
+
+            if (isLast)
+                break;
+        }
+
+        return numLevels;
+    }
+
+    /** Moves an interleaved spectrum into real parts followed by imaginary parts, which
+        keeps the multiply-accumulate loop down to plain contiguous arrays.
+    */
+    static void splitSpectrum(const float *const interleaved, float *const split, const int partitionSize) noexcept
+    {
+        for (int bin = 0; bin <= partitionSize; ++bin)
+        {
+            split[bin] = interleaved[2 * bin];
+            split[partitionSize + 1 + bin] = interleaved[2 * bin + 1];
+        }
+    }
+
+    static void interleaveSpectrum(const float *const split, float *const interleaved, const int partitionSize) noexcept
+    {
+        for (int bin = 0; bin <= partitionSize; ++bin)
+        {
+            interleaved[2 * bin] = split[bin];
+            interleaved[2 * bin + 1] = split[partitionSize + 1 + bin];
+        }
+    }
+
+    //==============================================================================
+    void allocate()
+    {
+        // the response no longer fits, so the audio thread starts again from silence
+        destroy(current);
+        current = nullptr;
+        destroy(pending.exchange(nullptr));
+        releaseRetiredImpulseResponses();
+
+        int partitionSizes[maximumLevels], starts[maximumLevels], numPartitions[maximumLevels];
+        numLevels = layoutLevels(historyLength, partitionSizes, starts, numPartitions);
+
+        ringSize = headSize;
+        size_t numFloats = 0;
+
+        for (int l = 0; l < numLevels; ++l)
+        {
+            auto &level = levels[l];
+            level.partitionSize = partitionSizes[l];
+            level.start = starts[l];
+            level.numPartitions = numPartitions[l];
+            level.fft = std::make_unique<dsp::FFT>(getFFTOrder(level.partitionSize));
+
+            // an input window of two partitions, a ring of past input spectra, and the sum
+            // building up for the end of the block
+            numFloats += (size_t)(numChannels * (2 * level.partitionSize + (level.numPartitions + 1) * getSpectrumSize(level.partitionSize)));
+            ringSize = jmax(ringSize, nextPowerOfTwo(level.start));
+        }
+
+        // the head reads its input history out of the first level's window, so that one
+        // always exists, even with nothing after the head to convolve
+        const int firstWindowSize = numLevels > 0 ? 0 : 2 * headSize;
+
+        numFloats += (size_t)(numChannels * (ringSize + headSize + firstWindowSize));
+        numFloats += (size_t)(4 * ringSize);
+
+        storageSize = numFloats;
+        storage.allocate(storageSize, true);
+
+        float *memory = storage.get();
+        auto take = [&memory](const int numFloatsToTake)
+        {
+            float *const start = memory;
+            memory += numFloatsToTake;
+            return start;
+        };
+
+        for (int l = 0; l < numLevels; ++l)
+        {
+            auto &level = levels[l];
+
+            for (int ch = 0; ch < numChannels; ++ch)
+            {
+                level.window[ch] = take(2 * level.partitionSize);
+                level.spectra[ch] = take(level.numPartitions * getSpectrumSize(level.partitionSize));
+                level.sum[ch] = take(getSpectrumSize(level.partitionSize));
+            }
+        }
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            tailRing[ch] = take(ringSize);
+            wet[ch] = take(headSize);
+            headWindow[ch] = numLevels > 0 ? levels[0].window[ch] : take(firstWindowSize);
+        }
+
+        fftData = take(4 * ringSize);
+
+        reset();
+    }
+
+    //==============================================================================
+    void process(float *const *channels, const int numChannelsToProcess, const int numSamples) noexcept
+    {
+        if (retired.load(std::memory_order_relaxed) == nullptr)
+        {
+            if (auto *next = pending.exchange(nullptr, std::memory_order_acquire))
+            {
+                retired.store(current != nullptr ? current : &silence, std::memory_order_release);
+                current = next != &silence ? next : nullptr;
+            }
+        }
+
+        for (int start = 0; start < numSamples;)
+        {
+            // every level's blocks are a whole number of head blocks, so none ends inside this run
+            const int headPosition = position & (headSize - 1);
+            const int num = jmin(numSamples - start, headSize - headPosition);
+
+            for (int ch = 0; ch < numChannelsToProcess; ++ch)
+            {
+                const float *const input = channels[ch] + start;
+
+                for (int l = 0; l < numLevels; ++l)
+                {
+                    const int size = levels[l].partitionSize;
+                    FloatVectorOperations::copy(levels[l].window[ch] + size + (position & (size - 1)), input, num);
+                }
+
+                if (numLevels == 0)
+                    FloatVectorOperations::copy(headWindow[ch] + headSize + headPosition, input, num);
+
+                float *const tail = tailRing[ch];
+
+                if (current != nullptr)
+                {
+                    // the head taps are stored reversed, so each output is one dot product over the window
+                    const float *const head = current->head + jmin(ch, current->numChannels - 1) * headSize;
+
+                    for (int i = 0; i < num; ++i)
+                    {
+                        const float *const history = headWindow[ch] + headPosition + i + 1;
+                        float sum = 0.0f;
+
+                        for (int tap = 0; tap < headSize; ++tap)
+                            sum += head[tap] * history[tap];
+
+                        const int ringIndex = (position + i) & (ringSize - 1);
+                        wet[ch][i] = sum + tail[ringIndex];
+                        tail[ringIndex] = 0.0f;
+                    }
+                }
+                else
+                {
+                    for (int i = 0; i < num; ++i)
+                    {
+                        const int ringIndex = (position + i) & (ringSize - 1);
+                        wet[ch][i] = tail[ringIndex];
+                        tail[ringIndex] = 0.0f;
+                    }
+                }
+            }
+
+            mix(channels, numChannelsToProcess, start, num);
+
+            position = (position + num) & (ringSize - 1);
+            start += num;
+
+            for (int l = 0; l < numLevels; ++l)
+            {
+                auto &level = levels[l];
+                const int elapsed = position & (level.partitionSize - 1);
+
+                if (elapsed == 0)
+                {
+                    for (int ch = 0; ch < numChannelsToProcess; ++ch)
+                        finishLevelBlock(l, ch);
+
+                    level.newestSlot = (level.newestSlot + 1) % level.numPartitions;
+                    level.numFilled = jmin(level.numFilled + 1, level.numPartitions);
+                    level.nextPartition = 1;
+                }
+                else if (current != nullptr && l < current->numLevels)
+                {
+                    // keep up with the share of the partitions that the samples so far stand for
+                    const int first = level.nextPartition;
+                    const int last = jmin(current->numPartitions[l], 1 + (current->numPartitions[l] - 1) * elapsed / level.partitionSize);
+
+                    for (int ch = 0; ch < numChannelsToProcess; ++ch)
+                        accumulatePartitions(l, ch, first, last);
+
+                    level.nextPartition = jmax(first, last);
+                }
+            }
+
+            if (numLevels == 0 && headPosition + num == headSize)
+                for (int ch = 0; ch < numChannelsToProcess; ++ch)
+                    FloatVectorOperations::copy(headWindow[ch], headWindow[ch] + headSize, headSize);
+        }
+    }
+
+    void mix(float *const *channels, const int numChannelsToProcess, const int start, const int numSamples) noexcept
+    {
+        if (numChannelsToProcess == 1)
+        {
+            float *const samples = channels[0] + start;
+            wetGain2.skip(numSamples);
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const float dry = dryGain.getNextValue();
+                samples[i] = wet[0][i] * wetGain1.getNextValue() + samples[i] * dry;
+            }
+
+            return;
+        }
+
+        float *const left = channels[0] + start;
+        float *const right = channels[1] + start;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const float dry = dryGain.getNextValue();
+            const float wet1 = wetGain1.getNextValue();
+            const float wet2 = wetGain2.getNextValue();
+
+            const float outL = wet[0][i], outR = wet[1][i];
+
+            left[i] = outL * wet1 + outR * wet2 + left[i] * dry;
+            right[i] = outR * wet1 + outL * wet2 + right[i] * dry;
+        }
+    }
+
+    /** Multiplies the input spectra with partitions first to last - 1 of a level, adding them
+        to the sum for the end of the level's next block. Partition p goes with the input block
+        p blocks before that one; blocks from before the last reset are skipped as silent.
+    */
+    void accumulatePartitions(const int l, const int ch, const int first, int last) noexcept
+    {
+        auto &level = levels[l];
+        last = jmin(last, level.numFilled + 1);
+
+        const int size = level.partitionSize;
+        const int spectrumSize = getSpectrumSize(size);
+        const int numBins = size + 1;
+        const float *const partitions = current->partitions + current->levelOffsets[l]
+                                        + (size_t)(jmin(ch, current->numChannels - 1) * current->numPartitions[l] * spectrumSize);
+        float *const yRe = level.sum[ch];
+        float *const yIm = yRe + numBins;
+
+        for (int p = first; p < last; ++p)
+        {
+            const int slot = (level.newestSlot - p + level.numPartitions) % level.numPartitions;
+            const float *const xRe = level.spectra[ch] + slot * spectrumSize;
+            const float *const xIm = xRe + numBins;
+            const float *const hRe = partitions + p * spectrumSize;
+            const float *const hIm = hRe + numBins;
+
+            for (int bin = 0; bin < numBins; ++bin)
+            {
+                yRe[bin] += xRe[bin] * hRe[bin] - xIm[bin] * hIm[bin];
+                yIm[bin] += xRe[bin] * hIm[bin] + xIm[bin] * hRe[bin];
+            }
+        }
+    }
+
+    /** Runs at the end of each of a level's blocks: transforms the block's input, adds the
+        partitions not yet done to the sum, and transforms that back into the tail ring, where
+        it is due.
+    */
+    void finishLevelBlock(const int l, const int ch) noexcept
+    {
+        auto &level = levels[l];
+        const int size = level.partitionSize;
+        const int spectrumSize = getSpectrumSize(size);
+        float *const window = level.window[ch];
+        float *const sum = level.sum[ch];
+
+        FloatVectorOperations::copy(fftData, window, 2 * size);
+        FloatVectorOperations::clear(fftData + 2 * size, 2 * size);
+        level.fft->performRealOnlyForwardTransform(fftData, true);
+        splitSpectrum(fftData, level.spectra[ch] + level.newestSlot * spectrumSize, size);
+
+        // the newest half of the window is the oldest half of the next one
+        FloatVectorOperations::copy(window, window + size, size);
+
+        if (current == nullptr || l >= current->numLevels)
+        {
+            // anything summed before the response went away is dropped with it
+            FloatVectorOperations::clear(sum, spectrumSize);
+            return;
+        }
+
+        // whatever the head blocks in between left over, and the block that just ended
+        accumulatePartitions(l, ch, level.nextPartition, current->numPartitions[l]);
+        accumulatePartitions(l, ch, 0, 1);
+
+        interleaveSpectrum(sum, fftData, size);
+        FloatVectorOperations::clear(sum, spectrumSize);
+        level.fft->performRealOnlyInverseTransform(fftData);
+
+        // overlap-save: only the second half of the frame is free of wrap-around. The block
+        // that just ended lands start samples later, which is at least the next block.
+        const int due = (position + level.start - size) & (ringSize - 1);
+        FloatVectorOperations::add(tailRing[ch] + due, fftData + size, size);
+    }
+
+    //==============================================================================
+    struct Level
+    {
+        int partitionSize = 0, start = 0, numPartitions = 0, newestSlot = 0;
+        int numFilled = 0;                // spectra written since the last reset, before the newest
+        int nextPartition = 1;            // the first partition not yet in the sum
+        std::unique_ptr<dsp::FFT> fft;
+        float *window[numChannels] = {};  // the previous block followed by the current one
+        float *spectra[numChannels] = {}; // a ring of the spectra of past input windows
+        float *sum[numChannels] = {};     // the spectrum being summed for the end of the block
+    };
+
+    Parameters parameters;
+    double currentSampleRate = 44100.0, maximumLengthSeconds = 10.0;
+    int headSize = 128, historyLength = 0;
+
+    HeapBlock<float> storage;
+    size_t storageSize = 0;
+
+    Level levels[maximumLevels];
+    int numLevels = 0;
+
+    // the convolution output still to be played, one ring per channel, long enough to reach the last level's start
+    float *tailRing[numChannels] = {};
+    int ringSize = 0, position = 0;
+
+    float *headWindow[numChannels] = {};
+    float *wet[numChannels] = {};
+    float *fftData = nullptr;
+
+    // current is only touched by the audio thread. pending carries a new response to it, and
+    // retired carries the old one back. &silence stands for "no response" in both, so that
+    // nullptr can mean "empty".
+    ImpulseResponse *current = nullptr;
+    std::atomic<ImpulseResponse *> pending{nullptr}, retired{nullptr};
+    ImpulseResponse silence;
+
+    SmoothedValue<float> dryGain, wetGain1, wetGain2;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ConvolutionReverb)
+};
@@ -0,0 +1,142 @@
+/*
+  ==============================================================================
+
+   Copyright 2023, 2024 Vitalii Voronkin
+
+   Reverb Project is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Reverb Project is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Simple Reverb. If not, see <http://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    A short cascade of all-pass filters that gives one output channel its own phase.
+
+    Channels fed from the same reverb would otherwise be copies of each other and fold into
+    a phantom image between the speakers. Every decorrelator index has its own set of delay
+    lengths, so the channels come out mutually incoherent while keeping a flat spectrum.
+*/
+class Decorrelator
+{
+public:
+    //==============================================================================
+    static constexpr int numStages = 3;
+    static constexpr int maximumIndex = 16;
+
+    /** Delay lengths in samples at 44.1kHz, one row per decorrelator index. All 48 are distinct
+        primes, each stage drawn from its own range, so no two rows share a delay.
+    */
+    static constexpr short tunings[maximumIndex][numStages] = {
+        {131, 307, 503},
+        {139, 313, 523},
+        {151, 331, 547},
+        {163, 347, 569},
+        {173, 359, 577},
+        {181, 373, 599},
+        {193, 383, 607},
+        {199, 397, 619},
+        {223, 409, 641},
+        {229, 421, 653},
+        {239, 433, 661},
+        {251, 443, 683},
+        {263, 461, 701},
+        {271, 467, 727},
+        {281, 487, 739},
+        {293, 499, 757},
+    };
+
+    Decorrelator() noexcept {}
+
+    /** Picks the row of tunings this decorrelator uses and sizes its lines for a sample rate.
+        This allocates, so call it before processing.
+    */
+    void prepare(const int index, const double sampleRate)
+    {
+        jassert(isPositiveAndBelow(index, maximumIndex) && sampleRate > 0);
+
+        int total = 0;
+
+        for (int s = 0; s < numStages; ++s)
+        {
+            stages[s].length = jmax(1, roundToInt(tunings[index][s] * sampleRate / 44100.0));
+            stages[s].offset = total;
+            total += stages[s].length;
+        }
+
+        memory.calloc((size_t)total);
+        memorySize = total;
+        reset();
+    }
+
+    /** Frees the delay memory until the next prepare. */
+    void release()
+    {
+        memory.free();
+        memorySize = 0;
+    }
+
+    void reset() noexcept
+    {
+        if (memory != nullptr)
+            FloatVectorOperations::clear(memory.get(), memorySize);
+
+        for (auto &stage : stages)
+            stage.index = 0;
+    }
+
+    /** Filters a block in place. */
+    void process(float *const samples, const int numSamples) noexcept
+    {
+        jassert(memory != nullptr);
+
+        for (auto &stage : stages)
+        {
+            float *const line = memory + stage.offset;
+            int index = stage.index;
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const float delayed = line[index];
+                const float w = samples[i] + gain * delayed;
+
+                line[index] = w;
+                samples[i] = delayed - gain * w;
+
+                if (++index == stage.length)
+                    index = 0;
+            }
+
+            stage.index = index;
+        }
+    }
+
+private:
+    //==============================================================================
+    static constexpr float gain = 0.5f;
+
+    struct Stage
+    {
+        int offset = 0, length = 1, index = 0;
+    };
+
+    Stage stages[numStages];
+    HeapBlock<float> memory;
+    int memorySize = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(Decorrelator)
+};
@@ -0,0 +1,275 @@
+/*
+  ==============================================================================
+
+   Copyright 2023, 2024 Vitalii Voronkin
+
+   Reverb Project is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Reverb Project is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Simple Reverb. If not, see <http://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    The first reflections off the walls of a room, as a handful of taps on one delay line.
+
+    Every channel reads the same mono line at numTaps delays of its own, each with its own gain.
+    The reflections come in sparse and grow denser towards the latest one, which is further
+    away in a bigger room; each arrives from somewhere across the stereo field, spread wider
+    with a wider width, and reaches the far channel a little later than the near one.
+
+    The taps for a grid of room sizes and widths are all worked out by prepare(), so choosing
+    a setting on the audio thread only picks a table. A new table fades in over fadeSeconds
+    while the old one fades out, so the taps never jump.
+
+    All taps read the samples of a block in a row, so each tap is one contiguous
+    multiply-add over the block rather than a gather per sample.
+*/
+template <int NumChannels, typename SampleType = float>
+class EarlyReflections
+{
+public:
+    //==============================================================================
+    static constexpr int numTaps = 16;
+    static constexpr int maximumBlockSize = 256;
+
+    /** The latest reflection of the smallest and of the biggest room. */
+    static constexpr double minimumSeconds = 0.015, maximumSeconds = 0.08;
+
+    /** How much later a reflection from one side reaches the channel on the other. */
+    static constexpr double maximumSpreadSeconds = 0.0003;
+
+    static constexpr double fadeSeconds = 0.01;
+
+    /** Where each reflection is read on the line, and how loud it is, in every channel. */
+    struct TapTable
+    {
+        int delays[NumChannels][numTaps];
+        float gains[NumChannels][numTaps];
+    };
+
+    EarlyReflections()
+    {
+        tables.malloc(numTables);
+        prepare(44100.0);
+    }
+
+    //==============================================================================
+    /** Works out every table for a sample rate and makes the line long enough for them.
+        This can allocate, so call it before processing, as ReverbFX::setSampleRate does.
+    */
+    void prepare(const double sampleRate)
+    {
+        jassert(sampleRate > 0);
+
+        const int longest = (int)std::ceil((maximumSeconds + maximumSpreadSeconds) * sampleRate);
+        const int size = nextPowerOfTwo(longest + maximumBlockSize + 1);
+
+        if (size > lineSize)
+        {
+            line.malloc(size);
+            lineSize = size;
+        }
+
+        for (int r = 0; r <= roomSteps; ++r)
+            for (int w = 0; w <= widthSteps; ++w)
+                fillTable(tables[r * (widthSteps + 1) + w], (float)r / roomSteps, (float)w / widthSteps, sampleRate);
+
+        fadeLength = jmax(1, roundToInt(fadeSeconds * sampleRate));
+        current = target = previous = &tables[getTableIndex(selectedRoomSize, selectedWidth)];
+        reset();
+    }
+
+    /** Chooses the reflections for a room size and width, both from 0 to 1.
+        Call it from the audio thread; the change is heard over the next fadeSeconds.
+    */
+    void select(const float newRoomSize, const float newWidth) noexcept
+    {
+        selectedRoomSize = jlimit(0.0f, 1.0f, newRoomSize);
+        selectedWidth = jlimit(0.0f, 1.0f, newWidth);
+        target = &tables[getTableIndex(selectedRoomSize, selectedWidth)];
+    }
+
+    /** Clears the line and lands on the chosen table at once. */
+    void reset() noexcept
+    {
+        FloatVectorOperations::clear(line.get(), lineSize);
+        writePosition = 0;
+        current = previous = target;
+        fadePosition = fadeLength;
+    }
+
+    //==============================================================================
+    /** Writes a block of input onto the end of the line. */
+    void push(const SampleType *const input, const int numSamples) noexcept
+    {
+        jassert(numSamples <= maximumBlockSize);
+        const int mask = lineSize - 1;
+
+        for (int i = 0; i < numSamples; ++i)
+            line[(writePosition + i) & mask] = input[i];
+
+        writePosition = (writePosition + numSamples) & mask;
+        lastPushed = numSamples;
+    }
+
+    /** Writes the reflections of the block just pushed into each channel of outputs. */
+    template <size_t BlockSize>
+    void read(SampleType (&outputs)[NumChannels][BlockSize], const int numSamples) noexcept
+    {
+        static_assert(BlockSize <= (size_t)maximumBlockSize);
+        jassert(numSamples == lastPushed);
+
+        // a new table waits for the fade in progress to finish, so no table is ever cut off
+        if (fadePosition >= fadeLength && target != current)
+        {
+            previous = current;
+            current = target;
+            fadePosition = 0;
+        }
+
+        for (int c = 0; c < NumChannels; ++c)
+            readTaps(*current, c, outputs[c], numSamples);
+
+        if (fadePosition >= fadeLength)
+            return;
+
+        const int numFading = jmin(numSamples, fadeLength - fadePosition);
+
+        for (int i = 0; i < numFading; ++i)
+            ramp[i] = (float)(fadePosition + i + 1) / (float)fadeLength;
+
+        for (int c = 0; c < NumChannels; ++c)
+        {
+            readTaps(*previous, c, faded, numFading);
+
+            for (int i = 0; i < numFading; ++i)
+                outputs[c][i] = faded[i] + (outputs[c][i] - faded[i]) * ramp[i];
+        }
+
+        fadePosition += numFading;
+    }
+
+    /** Returns the table in use, or the one being faded to. */
+    const TapTable &getTable() const noexcept { return *current; }
+
+private:
+    //==============================================================================
+    static constexpr int roomSteps = 16, widthSteps = 4;
+    static constexpr int numTables = (roomSteps + 1) * (widthSteps + 1);
+
+    static int getTableIndex(const float roomSize, const float width) noexcept
+    {
+        return roundToInt(roomSize * roomSteps) * (widthSteps + 1) + roundToInt(width * widthSteps);
+    }
+
+    /** Fills a table for one room size and width. Each channel ends up with the energy of a single
+        unit tap, so the reflections sit at about the same level in any room.
+    */
+    static void fillTable(TapTable &table, const float roomSize, const float width, const double sampleRate) noexcept
+    {
+        const double latest = minimumSeconds + (maximumSeconds - minimumSeconds) * roomSize;
+        const double earliest = 0.1 * latest;
+        double energy = 0;
+
+        for (int k = 0; k < numTaps; ++k)
+        {
+            // golden ratio sequences jitter the arrivals and scatter the directions without any
+            // randomness, so every instance and every sample rate hears the same room
+            const double jitter = sequence(k, 0.6180339887) - 0.5;
+            const double place = (k + 0.5 + 0.8 * jitter) / numTaps;
+
+            // the number of reflections grows with the square of time, so their spacing shrinks
+            const double time = earliest + (latest - earliest) * std::sqrt(place);
+            const double amplitude = (k % 2 == 0 ? 1.0 : -1.0) * earliest / time;
+            const double direction = (2.0 * sequence(k, 0.7548776662) - 1.0) * width;
+
+            double weights[NumChannels], sumOfSquares = 0;
+
+            for (int c = 0; c < NumChannels; ++c)
+            {
+                weights[c] = 0.5 * (1.0 + direction * getPosition(c));
+                sumOfSquares += weights[c] * weights[c];
+            }
+
+            for (int c = 0; c < NumChannels; ++c)
+            {
+                const double lag = jmax(0.0, -direction * getPosition(c)) * maximumSpreadSeconds;
+                table.delays[c][k] = jmax(1, roundToInt((time + lag) * sampleRate));
+                table.gains[c][k] = (float)(amplitude * weights[c] / std::sqrt(sumOfSquares));
+                energy += (double)table.gains[c][k] * table.gains[c][k];
+            }
+        }
+
+        const double normalise = std::sqrt(NumChannels / energy);
+
+        for (auto &gains : table.gains)
+            for (auto &gain : gains)
+                gain = (float)(gain * normalise);
+    }
+
+    /** Where a channel sits across the stereo field, from -1 (left) to 1 (right). */
+    static double getPosition(const int channel) noexcept
+    {
+        return NumChannels > 1 ? -1.0 + 2.0 * channel / (NumChannels - 1) : 0.0;
+    }
+
+    static double sequence(const int k, const double step) noexcept
+    {
+        const double value = (k + 1) * step;
+        return value - std::floor(value);
+    }
+
+    /** Writes the sum of one channel's taps over the last numSamples pushed. */
+    void readTaps(const TapTable &table, const int channel, SampleType *const output, const int numSamples) const noexcept
+    {
+        const int mask = lineSize - 1;
+        const int blockStart = writePosition - lastPushed;
+
+        FloatVectorOperations::clear(output, numSamples);
+
+        for (int k = 0; k < numTaps; ++k)
+        {
+            const SampleType gain = (SampleType)table.gains[channel][k];
+            const int start = (blockStart - table.delays[channel][k]) & mask;
+
+            // the run splits in two where it wraps round the end of the line
+            const int firstRun = jmin(numSamples, lineSize - start);
+            const SampleType *const source = line.get() + start;
+
+            for (int i = 0; i < firstRun; ++i)
+                output[i] += source[i] * gain;
+
+            for (int i = firstRun; i < numSamples; ++i)
+                output[i] += line[i - firstRun] * gain;
+        }
+    }
+
+    //==============================================================================
+    HeapBlock<TapTable> tables;
+    const TapTable *current = nullptr, *previous = nullptr, *target = nullptr;
+    float selectedRoomSize = 0.5f, selectedWidth = 1.0f;
+
+    HeapBlock<SampleType> line;
+    int lineSize = 0, writePosition = 0, lastPushed = 0;
+    int fadeLength = 1, fadePosition = 0;
+
+    float ramp[maximumBlockSize];
+    SampleType faded[maximumBlockSize];
+
+    JUCE_DECLARE_NON_COPYABLE(EarlyReflections)
+};
@@ -0,0 +1,446 @@
+/*
+  ==============================================================================
+
+   Copyright 2023, 2024 Vitalii Voronkin
+
+   Reverb Project is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Reverb Project is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Simple Reverb. If not, see <http://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "ReverbFX.h"
+
+//==============================================================================
+/**
+    A feedback delay network reverb with NumLines delay lines, mixed by a Hadamard matrix.
+
+    It takes the same Parameters as ReverbFX, so the two can be swapped per instance:
+    roomSize and freezeMode set the decay (a given roomSize decays at the rate of a
+    ReverbFX comb), damping filters the feedback, width spreads the output, and
+    diffusionFeedback sets the allpass diffusion in front of the network.
+
+    Every delay line is longer than one processing chunk, so a whole chunk can be read out
+    of each line before anything is written back. The matrix then runs as log2(NumLines)
+    passes of butterflies over contiguous chunks, which vectorise like any other buffer loop.
+*/
+template <int NumLines>
+class FDNReverb
+{
+public:
+    //==============================================================================
+    using Parameters = ReverbFX::Parameters;
+
+    FDNReverb()
+    {
+        allocateArena(layoutDelayLines(ReverbFX::maximumSampleRate, nullptr));
+        setParameters(Parameters());
+        setSampleRate(44100.0);
+    }
+
+    //==============================================================================
+    /** Returns the reverb's current parameters. */
+    const Parameters &getParameters() const noexcept { return parameters; }
+
+    /** Applies a new set of parameters to the reverb.
+        As with ReverbFX, call this from the audio thread or between process calls.
+    */
+    void setParameters(const Parameters &newParams)
+    {
+        const auto coefficients = ReverbFX::getCoefficients(newParams);
+
+        dryGain.setTargetValue(coefficients.dryGain);
+        wetGain1.setTargetValue(coefficients.wetGain1);
+        wetGain2.setTargetValue(coefficients.wetGain2);
+        damping.setTargetValue(coefficients.damping);
+        feedback.setTargetValue(coefficients.feedback);
+
+        gain = coefficients.inputGain;
+        diffusionGain = jlimit(0.0f, maximumDiffusion, newParams.diffusionFeedback);
+        parameters = newParams;
+    }
+
+    //==============================================================================
+    /** Sets the sample rate that will be used for the reverb.
+        You must call this before the process methods, in order to tell it the correct sample rate.
+    */
+    void setSampleRate(const double sampleRate)
+    {
+        jassert(sampleRate > 0);
+
+        const auto numFloatsNeeded = layoutDelayLines(sampleRate, nullptr);
+
+        if (numFloatsNeeded > arenaSize)
+            allocateArena(numFloatsNeeded);
+
+        arenaUsed = layoutDelayLines(sampleRate, arena);
+
+        chunkSize = blockSize;
+
+        for (auto &line : lines)
+            chunkSize = jmin(chunkSize, line.length);
+
+        referenceLength = (float)ReverbFX::Tunings::scale(referenceTuning, sampleRate);
+
+        const double smoothTime = 0.01;
+        damping.reset(sampleRate, smoothTime);
+        feedback.reset(sampleRate, smoothTime);
+        dryGain.reset(sampleRate, smoothTime);
+        wetGain1.reset(sampleRate, smoothTime);
+        wetGain2.reset(sampleRate, smoothTime);
+
+        updateLineGains(feedback.getTargetValue());
+        reset();
+    }
+
+    /** Clears the reverb's buffers. Only the part of the arena the lines use at the current
+        sample rate is touched, so this is safe from the audio thread.
+    */
+    void reset()
+    {
+        FloatVectorOperations::clear(arena, (int)arenaUsed);
+
+        for (auto &line : lines)
+            line.index = 0;
+
+        std::fill(std::begin(lowpass), std::end(lowpass), 0.0f);
+
+        for (auto &filter : diffusers)
+            filter.index = 0;
+    }
+
+    /** Returns the number of bytes of delay memory owned by this reverb. */
+    size_t getMemoryFootprint() const noexcept { return arenaSize * sizeof(float); }
+
+    //==============================================================================
+    /** Applies the reverb to two stereo channels of audio data. */
+    void processStereo(float *const left, float *const right, const int numSamples) noexcept
+    {
+        jassert(left != nullptr && right != nullptr);
+        const ScopedNoDenormals noDenormals;
+
+        for (int start = 0; start < numSamples; start += chunkSize)
+        {
+            const int num = jmin(chunkSize, numSamples - start);
+            float *const l = left + start;
+            float *const r = right + start;
+
+            for (int i = 0; i < num; ++i)
+                inputBuffer[i] = (l[i] + r[i]) * gain;
+
+            processNetwork(num);
+
+            for (int i = 0; i < num; ++i)
+            {
+                const float dry = dryGain.getNextValue();
+                const float wet1 = wetGain1.getNextValue();
+                const float wet2 = wetGain2.getNextValue();
+
+                const float outL = tapBuffer[0][i], outR = tapBuffer[1][i];
+
+                l[i] = outL * wet1 + outR * wet2 + l[i] * dry;
+                r[i] = outR * wet1 + outL * wet2 + r[i] * dry;
+            }
+        }
+    }
+
+    /** Applies the reverb to a single mono channel of audio data. */
+    void processMono(float *const samples, const int numSamples) noexcept
+    {
+        jassert(samples != nullptr);
+        const ScopedNoDenormals noDenormals;
+
+        for (int start = 0; start < numSamples; start += chunkSize)
+        {
+            const int num = jmin(chunkSize, numSamples - start);
+            float *const s = samples + start;
+
+            for (int i = 0; i < num; ++i)
+                inputBuffer[i] = s[i] * gain;
+
+            processNetwork(num);
+
+            // the two taps are uncorrelated, so their sum is scaled to keep the power of one
+            const float foldGain = MathConstants<float>::sqrt2 * 0.5f;
+
+            for (int i = 0; i < num; ++i)
+            {
+                const float dry = dryGain.getNextValue();
+                const float wet = wetGain1.getNextValue() + wetGain2.getNextValue();
+
+                s[i] = (tapBuffer[0][i] + tapBuffer[1][i]) * (wet * foldGain) + s[i] * dry;
+            }
+        }
+    }
+
+private:
+    //==============================================================================
+    enum
+    {
+        numDiffusers = 4,
+        blockSize = 128,
+        floatsPerCacheLine = 64 / sizeof(float)
+    };
+
+    static_assert(NumLines >= 2 && (NumLines & (NumLines - 1)) == 0, "the Hadamard matrix needs a power of two lines");
+
+    /** Line lengths at 44.1kHz are spread exponentially over this range, then moved to primes. */
+    static constexpr int shortestTuning = 587, longestTuning = 2153;
+
+    /** A line of this length at 44.1kHz decays like a ReverbFX comb with the same feedback. */
+    static constexpr int referenceTuning = 1356;
+
+    static constexpr short diffuserTunings[numDiffusers] = {142, 107, 379, 277};
+    static constexpr float maximumDiffusion = 0.75f;
+
+    //==============================================================================
+    static int getLineLength(const int line, const double sampleRate) noexcept
+    {
+        const double position = (double)line / (double)(NumLines - 1);
+        const double tuning = shortestTuning * std::pow((double)longestTuning / shortestTuning, position);
+
+        return nextPrime(jmax(2, ReverbFX::Tunings::scale(roundToInt(tuning), sampleRate)));
+    }
+
+    /** Mutually prime lengths keep the echoes of different lines from piling up. */
+    static int nextPrime(int n) noexcept
+    {
+        for (;; ++n)
+        {
+            bool isPrime = true;
+
+            for (int d = 2; d * d <= n && isPrime; ++d)
+                isPrime = n % d != 0;
+
+            if (isPrime)
+                return n;
+        }
+    }
+
+    /** Works out every delay line length for a sample rate and, if memory is given, points each
+        line at its slice of it. Returns the number of floats the layout needs.
+    */
+    size_t layoutDelayLines(const double sampleRate, float *const memory)
+    {
+        size_t numFloatsUsed = 0;
+
+        auto carve = [memory, &numFloatsUsed](const int numFloats) -> float *
+        {
+            float *const start = memory != nullptr ? memory + numFloatsUsed : nullptr;
+            numFloatsUsed += ((size_t)numFloats + floatsPerCacheLine - 1) & ~(size_t)(floatsPerCacheLine - 1);
+            return start;
+        };
+
+        for (int i = 0; i < NumLines; ++i)
+        {
+            const int length = getLineLength(i, sampleRate);
+
+            if (auto *lineMemory = carve(length))
+                lines[i].setBuffer(lineMemory, length);
+        }
+
+        for (int i = 0; i < numDiffusers; ++i)
+        {
+            const int length = jmax(1, ReverbFX::Tunings::scale(diffuserTunings[i], sampleRate));
+
+            if (auto *lineMemory = carve(length))
+                diffusers[i].setBuffer(lineMemory, length);
+        }
+
+        return numFloatsUsed;
+    }
+
+    void allocateArena(const size_t numFloats)
+    {
+        arenaStorage.malloc(numFloats + floatsPerCacheLine);
+        arena = snapPointerToAlignment(arenaStorage.get(), floatsPerCacheLine * sizeof(float));
+        arenaSize = numFloats;
+    }
+
+    /** Spreads the feedback over the lines so they all decay at the same rate, with the
+        matrix normalisation folded in.
+    */
+    void updateLineGains(const float feedbackLevel) noexcept
+    {
+        const float normalisation = 1.0f / std::sqrt((float)NumLines);
+
+        for (int i = 0; i < NumLines; ++i)
+            lineGains[i] = std::pow(feedbackLevel, (float)lines[i].length / referenceLength) * normalisation;
+    }
+
+    //==============================================================================
+    /** Runs one chunk of inputBuffer through the network and leaves the two outputs in tapBuffer. */
+    void processNetwork(const int numSamples) noexcept
+    {
+        for (auto &filter : diffusers)
+            filter.process(inputBuffer, diffusionGain, numSamples);
+
+        // the damping and feedback ramps advance once per chunk, which is at most a few ms
+        const float dampingLevel = damping.skip(numSamples);
+
+        if (feedback.isSmoothing())
+            updateLineGains(feedback.skip(numSamples));
+
+        FloatVectorOperations::clear(tapBuffer[0], numSamples);
+        FloatVectorOperations::clear(tapBuffer[1], numSamples);
+
+        for (int i = 0; i < NumLines; ++i)
+            lines[i].read(lineBuffer[i], numSamples);
+
+        // the lowpass of every line advances together, so the recursions overlap instead of
+        // each waiting on its own previous sample
+        const float inputLevel = 1.0f - dampingLevel;
+
+        for (int n = 0; n < numSamples; ++n)
+            for (int i = 0; i < NumLines; ++i)
+                lineBuffer[i][n] = lowpass[i] = lineBuffer[i][n] * inputLevel + lowpass[i] * dampingLevel;
+
+        for (int i = 0; i < NumLines; ++i)
+        {
+            float *const samples = lineBuffer[i];
+
+            // even lines feed the left output and odd lines the right
+            FloatVectorOperations::add(tapBuffer[i & 1], samples, numSamples);
+            FloatVectorOperations::multiply(samples, lineGains[i], numSamples);
+        }
+
+        // fast Walsh-Hadamard transform across the lines
+        for (int span = 1; span < NumLines; span *= 2)
+        {
+            for (int first = 0; first < NumLines; first += 2 * span)
+            {
+                for (int i = first; i < first + span; ++i)
+                {
+                    float *const a = lineBuffer[i];
+                    float *const b = lineBuffer[i + span];
+
+                    for (int n = 0; n < numSamples; ++n)
+                    {
+                        const float x = a[n], y = b[n];
+                        a[n] = x + y;
+                        b[n] = x - y;
+                    }
+                }
+            }
+        }
+
+        for (int i = 0; i < NumLines; ++i)
+        {
+            float *const samples = lineBuffer[i];
+
+            // alternating signs keep the input from lining up with a single matrix column
+            if (i & 1)
+                FloatVectorOperations::subtract(samples, inputBuffer, numSamples);
+            else
+                FloatVectorOperations::add(samples, inputBuffer, numSamples);
+
+            lines[i].write(samples, numSamples);
+        }
+
+        FloatVectorOperations::multiply(tapBuffer[0], outputGain, numSamples);
+        FloatVectorOperations::multiply(tapBuffer[1], outputGain, numSamples);
+    }
+
+    //==============================================================================
+    /** One feedback line. Its damping lowpass state lives in lowpass[], next to the others. */
+    struct DelayLine
+    {
+        void setBuffer(float *const memory, const int size) noexcept
+        {
+            buffer = memory;
+            length = size;
+            index = 0;
+        }
+
+        /** Copies the next numSamples delayed samples out; numSamples must not exceed length. */
+        void read(float *const dest, const int numSamples) const noexcept
+        {
+            const int first = jmin(numSamples, length - index);
+            FloatVectorOperations::copy(dest, buffer + index, first);
+            FloatVectorOperations::copy(dest + first, buffer, numSamples - first);
+        }
+
+        /** Writes over the samples just read and moves past them. */
+        void write(const float *const source, const int numSamples) noexcept
+        {
+            const int first = jmin(numSamples, length - index);
+            FloatVectorOperations::copy(buffer + index, source, first);
+            FloatVectorOperations::copy(buffer, source + first, numSamples - first);
+
+            index += numSamples;
+
+            if (index >= length)
+                index -= length;
+        }
+
+        float *buffer = nullptr;
+        int length = 0, index = 0;
+    };
+
+    /** A Schroeder allpass, used in series to smear the input before the network. */
+    struct Diffuser
+    {
+        void setBuffer(float *const memory, const int size) noexcept
+        {
+            buffer = memory;
+            length = size;
+            index = 0;
+        }
+
+        void process(float *const samples, const float g, const int numSamples) noexcept
+        {
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const float delayed = buffer[index];
+                const float w = samples[i] - g * delayed;
+
+                buffer[index] = w;
+                samples[i] = delayed + g * w;
+
+                if (++index >= length)
+                    index = 0;
+            }
+        }
+
+        float *buffer = nullptr;
+        int length = 0, index = 0;
+    };
+
+    //==============================================================================
+    /** Brings the summed line outputs to about the level of ReverbFX's wet signal. */
+    const float outputGain = 8.0f * std::sqrt(2.0f / (float)NumLines);
+
+    Parameters parameters;
+    float gain = 0, diffusionGain = 0, referenceLength = 1;
+    int chunkSize = blockSize;
+
+    HeapBlock<float> arenaStorage;
+    float *arena = nullptr;
+    size_t arenaSize = 0, arenaUsed = 0; // allocated for the highest sample rate, used for the current one
+
+    DelayLine lines[NumLines];
+    Diffuser diffusers[numDiffusers];
+    float lineGains[NumLines] = {};
+    float lowpass[NumLines] = {};
+
+    SmoothedValue<float> damping, feedback, dryGain, wetGain1, wetGain2;
+
+    float inputBuffer[blockSize] = {};
+    float tapBuffer[2][blockSize] = {};
+    float lineBuffer[NumLines][blockSize] = {};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(FDNReverb)
+};
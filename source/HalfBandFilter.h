@@ -0,0 +1,195 @@
+/*
+  ==============================================================================
+
+   Copyright 2023, 2024 Vitalii Voronkin
+
+   Reverb Project is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Reverb Project is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Simple Reverb. If not, see <http://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Coefficients of a linear-phase half-band lowpass, for changing the sample rate by two.
+
+    A half-band filter has every other tap at zero apart from the centre one, which is 0.5, so
+    only the 2 * NumPairs non-zero side taps are kept. Decimating or interpolating with it then
+    splits into a short FIR on one phase and a plain delay on the other. The taps are a
+    Kaiser-windowed sinc; more pairs make the transition around a quarter of the rate narrower.
+*/
+template <int NumPairs>
+struct HalfBandCoefficients
+{
+    static constexpr int numTaps = 2 * NumPairs;
+
+    HalfBandCoefficients() noexcept
+    {
+        const double beta = 8.0;
+        const double centre = numTaps - 0.5;
+        double sum = 0;
+
+        for (int i = 0; i < numTaps; ++i)
+        {
+            // the side taps sit an odd number of full-rate samples from the centre
+            const double offset = 2 * i - centre + 0.5;
+            const double ratio = offset / (centre + 0.5);
+            const double window = besselI0(beta * std::sqrt(jmax(0.0, 1.0 - ratio * ratio))) / besselI0(beta);
+            const double sinc = std::sin(MathConstants<double>::halfPi * offset) / (MathConstants<double>::pi * offset);
+
+            taps[i] = (float)(sinc * window);
+            sum += sinc * window;
+        }
+
+        // the side taps carry the other half of the DC gain
+        for (auto &tap : taps)
+            tap = (float)(tap * 0.5 / sum);
+    }
+
+    float taps[numTaps];
+
+private:
+    static double besselI0(const double x) noexcept
+    {
+        double sum = 1, term = 1;
+
+        for (int k = 1; k < 32; ++k)
+        {
+            term *= (x / (2 * k)) * (x / (2 * k));
+            sum += term;
+        }
+
+        return sum;
+    }
+};
+
+//==============================================================================
+/**
+    Halves the sample rate of one channel, consuming any number of samples per call.
+
+    An output comes out for every second input, so the count per call varies by one with the
+    phase the previous call left off at. Processing in place is allowed.
+*/
+template <int NumPairs, typename SampleType = float>
+class HalfBandDecimator
+{
+public:
+    HalfBandDecimator() noexcept { reset(); }
+
+    void reset() noexcept
+    {
+        FloatVectorOperations::clear(evenHistory, 2 * numTaps);
+        FloatVectorOperations::clear(oddHistory, 2 * numTaps);
+        evenIndex = oddIndex = 0;
+        odd = false;
+    }
+
+    /** Filters numSamples inputs and writes the outputs they complete. Returns the number written. */
+    int process(const SampleType *const input, SampleType *const output, const int numSamples) noexcept
+    {
+        int numOutputs = 0;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            if (odd)
+            {
+                push(oddHistory, oddIndex, input[i]);
+                odd = false;
+                continue;
+            }
+
+            push(evenHistory, evenIndex, input[i]);
+            odd = true;
+
+            // evenHistory[evenIndex + k] holds the even input k outputs back, so the window is contiguous
+            const SampleType *const evens = evenHistory + evenIndex;
+            SampleType sum = SampleType(0.5) * oddHistory[oddIndex + NumPairs - 1];
+
+            for (int k = 0; k < numTaps; ++k)
+                sum += coefficients.taps[k] * evens[k];
+
+            output[numOutputs++] = sum;
+        }
+
+        return numOutputs;
+    }
+
+private:
+    static constexpr int numTaps = HalfBandCoefficients<NumPairs>::numTaps;
+
+    /** Stores a sample twice, half a history apart, so the newest numTaps samples are always contiguous. */
+    static void push(SampleType *const history, int &index, const SampleType sample) noexcept
+    {
+        index = (index == 0 ? numTaps : index) - 1;
+        history[index] = history[index + numTaps] = sample;
+    }
+
+    static inline const HalfBandCoefficients<NumPairs> coefficients;
+
+    SampleType evenHistory[2 * numTaps], oddHistory[2 * numTaps];
+    int evenIndex = 0, oddIndex = 0;
+    bool odd = false;
+
+    JUCE_DECLARE_NON_COPYABLE(HalfBandDecimator)
+};
+
+//==============================================================================
+/**
+    Doubles the sample rate of one channel: every input sample yields two outputs.
+*/
+template <int NumPairs, typename SampleType = float>
+class HalfBandInterpolator
+{
+public:
+    HalfBandInterpolator() noexcept { reset(); }
+
+    void reset() noexcept
+    {
+        FloatVectorOperations::clear(history, 2 * numTaps);
+        index = 0;
+    }
+
+    /** Writes 2 * numSamples outputs. The output must not overlap the input. */
+    void process(const SampleType *const input, SampleType *const output, const int numSamples) noexcept
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            index = (index == 0 ? numTaps : index) - 1;
+            history[index] = history[index + numTaps] = input[i];
+
+            const SampleType *const recent = history + index;
+            SampleType sum = 0;
+
+            for (int k = 0; k < numTaps; ++k)
+                sum += coefficients.taps[k] * recent[k];
+
+            // the zeros stuffed in between halve the level, which the gain of two makes up
+            output[2 * i] = SampleType(2) * sum;
+            output[2 * i + 1] = recent[NumPairs - 1];
+        }
+    }
+
+private:
+    static constexpr int numTaps = HalfBandCoefficients<NumPairs>::numTaps;
+
+    static inline const HalfBandCoefficients<NumPairs> coefficients;
+
+    SampleType history[2 * numTaps];
+    int index = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(HalfBandInterpolator)
+};
@@ -0,0 +1,146 @@
+/*
+  ==============================================================================
+
+   Copyright 2023, 2024 Vitalii Voronkin
+
+   Reverb Project is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Reverb Project is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Simple Reverb. If not, see <http://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Times every block against its real-time budget, for spotting instances close to a dropout.
+
+    The audio thread writes the load of each block (time taken / block duration) into a ring
+    of the most recent blocks, with nothing but relaxed atomic stores. Any other thread can
+    ask for the percentiles of the ring at any time; entries the audio thread overwrites while
+    they are read just count towards the newer block, which doesn't matter for statistics.
+*/
+class LoadMonitor
+{
+public:
+    //==============================================================================
+    /** The number of most recent blocks the statistics cover. */
+    static constexpr int capacity = 1024;
+
+    /** Loads are fractions of the block's duration: 1 means the block took as long as it lasts. */
+    struct Statistics
+    {
+        float p50 = 0;
+        float p99 = 0;
+        float max = 0;
+        int numBlocks = 0;    /**< Blocks the percentiles are taken over, at most capacity. */
+        int64 numOverruns = 0; /**< Blocks that took longer than they last, since the last reset. */
+    };
+
+    LoadMonitor() noexcept {}
+
+    /** Sets the rate that turns block sizes into budgets. Call it before processing. */
+    void setSampleRate(const double sampleRate) noexcept
+    {
+        jassert(sampleRate > 0);
+        secondsPerSample = 1.0 / sampleRate;
+    }
+
+    /** Forgets every block so far. Not to be called while the audio thread records. */
+    void reset() noexcept
+    {
+        for (auto &load : loads)
+            load.store(0.0f, std::memory_order_relaxed);
+
+        numRecorded.store(0, std::memory_order_relaxed);
+        numOverruns.store(0, std::memory_order_relaxed);
+    }
+
+    //==============================================================================
+    /** Times the block it lives for. Audio thread only. */
+    class ScopedBlock
+    {
+    public:
+        ScopedBlock(LoadMonitor &monitorToUse, const int numSamplesInBlock) noexcept
+            : monitor(monitorToUse), numSamples(numSamplesInBlock), startTicks(Time::getHighResolutionTicks())
+        {
+        }
+
+        ~ScopedBlock() noexcept { monitor.record(Time::getHighResolutionTicks() - startTicks, numSamples); }
+
+    private:
+        LoadMonitor &monitor;
+        const int numSamples;
+        const int64 startTicks;
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedBlock)
+    };
+
+    /** Adds a block that took the given number of high-resolution ticks. Audio thread only. */
+    void record(const int64 ticks, const int numSamples) noexcept
+    {
+        if (numSamples <= 0)
+            return;
+
+        const auto load = (float)(Time::highResolutionTicksToSeconds(ticks) / (numSamples * secondsPerSample));
+        const auto index = numRecorded.load(std::memory_order_relaxed);
+
+        loads[index & (capacity - 1)].store(load, std::memory_order_relaxed);
+        numRecorded.store(index + 1, std::memory_order_release);
+
+        if (load > 1.0f)
+            numOverruns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    //==============================================================================
+    /** Returns the percentiles of the most recent blocks. Any thread but the audio thread. */
+    Statistics getStatistics() const noexcept
+    {
+        Statistics statistics;
+        statistics.numBlocks = (int)jmin((int64)capacity, numRecorded.load(std::memory_order_acquire));
+        statistics.numOverruns = numOverruns.load(std::memory_order_relaxed);
+
+        if (statistics.numBlocks == 0)
+            return statistics;
+
+        std::array<float, capacity> sorted;
+
+        for (int i = 0; i < statistics.numBlocks; ++i)
+            sorted[(size_t)i] = loads[i].load(std::memory_order_relaxed);
+
+        const auto end = sorted.begin() + statistics.numBlocks;
+        auto at = [&sorted, end, n = statistics.numBlocks](const float fraction)
+        {
+            const auto nth = sorted.begin() + jmin(n - 1, (int)(fraction * (float)n));
+            std::nth_element(sorted.begin(), nth, end);
+            return *nth;
+        };
+
+        statistics.p50 = at(0.5f);
+        statistics.p99 = at(0.99f);
+        statistics.max = *std::max_element(sorted.begin(), end);
+        return statistics;
+    }
+
+private:
+    //==============================================================================
+    static_assert(isPowerOfTwo(capacity), "the ring is indexed with a mask");
+
+    std::atomic<float> loads[capacity] = {};
+    std::atomic<int64> numRecorded{0}, numOverruns{0};
+    double secondsPerSample = 1.0 / 44100.0;
+
+    JUCE_DECLARE_NON_COPYABLE(LoadMonitor)
+};
@@ -0,0 +1,164 @@
+/*
+  ==============================================================================
+
+   Copyright 2023, 2024 Vitalii Voronkin
+
+   Reverb Project is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Reverb Project is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Simple Reverb. If not, see <http://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "ReverbState.h"
+
+//==============================================================================
+/** A set of parameter values that takes effect at a sample offset within a block. */
+struct ParameterEvent
+{
+    int sampleOffset = 0;
+    PluginParameterValues values;
+};
+
+//==============================================================================
+/**
+    The parameter changes of one block, kept in the order of their sample offsets.
+
+    processSubBlocks splits the block at every change, so each stretch runs with constant
+    parameters and the changes land on their sample instead of at the start of the next block.
+    The list has a fixed capacity and never allocates, so it can be filled on the audio thread.
+
+    ReverbRender fills it from --automate, which knows where each change falls. JUCE passes on
+    host changes without their position in the block, so the plugin fills it with addRamp,
+    which moves the continuous parameters across the block in short stretches instead of
+    jumping at its start.
+*/
+class ParameterEventList
+{
+public:
+    //==============================================================================
+    static constexpr int capacity = 64;
+    static constexpr int minimumRampStep = 64;
+
+    ParameterEventList() noexcept {}
+
+    /** Adds a change at an offset. A change at the same offset as an earlier one replaces it.
+        When the list is full, the change is merged into the latest one before its offset; if
+        there is none, it is dropped, as the changes after it hold the values the block ends on
+        anyway.
+    */
+    void add(const int sampleOffset, const PluginParameterValues &values) noexcept
+    {
+        jassert(sampleOffset >= 0);
+
+        int index = numEvents;
+
+        while (index > 0 && events[index - 1].sampleOffset > sampleOffset)
+            --index;
+
+        if (index > 0 && events[index - 1].sampleOffset == sampleOffset)
+        {
+            events[index - 1].values = values;
+            return;
+        }
+
+        if (numEvents == capacity)
+        {
+            // more changes in one block than the list holds
+            jassertfalse;
+
+            if (index > 0)
+                events[index - 1].values = values;
+
+            return;
+        }
+
+        for (int i = numEvents; i > index; --i)
+            events[i] = events[i - 1];
+
+        events[index] = {sampleOffset, values};
+        ++numEvents;
+    }
+
+    /** Adds changes that take the continuous parameters from one set of values to another in
+        equal steps across a block, reaching them on its last stretch. Freeze and the engine are
+        switches, so they take their new values from the start. Each stretch is at least
+        minimumRampStep samples long, and the steps never overflow the list.
+    */
+    void addRamp(const PluginParameterValues &from, const PluginParameterValues &to, const int numSamples) noexcept
+    {
+        const int room = jmax(1, capacity - numEvents);
+        const int step = jmax((int)minimumRampStep, (numSamples + room - 1) / room);
+        const int numSteps = jmax(1, (numSamples + step - 1) / step);
+
+        for (int i = 0; i < numSteps; ++i)
+        {
+            const float proportion = (float)(i + 1) / (float)numSteps;
+            auto lerp = [proportion](const float start, const float end)
+            { return start + (end - start) * proportion; };
+
+            auto values = to;
+            values.size = lerp(from.size, to.size);
+            values.damp = lerp(from.damp, to.damp);
+            values.width = lerp(from.width, to.width);
+            values.mix = lerp(from.mix, to.mix);
+            values.diffFeedbck = lerp(from.diffFeedbck, to.diffFeedbck);
+            values.modDepth = lerp(from.modDepth, to.modDepth);
+            values.modRate = lerp(from.modRate, to.modRate);
+            values.early = lerp(from.early, to.early);
+
+            add(i * step, values);
+        }
+    }
+
+    void clear() noexcept { numEvents = 0; }
+
+    bool isEmpty() const noexcept { return numEvents == 0; }
+    int size() const noexcept { return numEvents; }
+    const ParameterEvent &operator[](const int index) const noexcept { return events[index]; }
+
+    /** Calls process(start, numSamples) for each stretch of the block between changes, and
+        apply(values) for each change before the stretch it starts. Changes past the end of the
+        block are applied after the last stretch.
+    */
+    template <typename Apply, typename Process>
+    void processSubBlocks(const int numSamples, Apply &&apply, Process &&process) const
+    {
+        int start = 0;
+
+        for (int i = 0; i < numEvents; ++i)
+        {
+            const int offset = jmin(events[i].sampleOffset, numSamples);
+
+            if (offset > start)
+            {
+                process(start, offset - start);
+                start = offset;
+            }
+
+            apply(events[i].values);
+        }
+
+        if (start < numSamples)
+            process(start, numSamples - start);
+    }
+
+private:
+    //==============================================================================
+    ParameterEvent events[capacity];
+    int numEvents = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(ParameterEventList)
+};
@@ -9,13 +9,57 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
+//==============================================================================
+LoadMeter::LoadMeter(const ReverbProjectAudioProcessor &p)
+    : audioProcessor(p)
+{
+  startTimerHz(10);
+}
+
+void LoadMeter::timerCallback()
+{
+  statistics = audioProcessor.getLoadStatistics();
+  repaint();
+}
+
+void LoadMeter::paint(juce::Graphics &g)
+{
+  auto bounds = getLocalBounds().reduced(4);
+  const auto text = bounds.removeFromRight(bounds.getWidth() / 2);
+  const auto toWidth = [&bounds](const float load)
+  { return (float)bounds.getWidth() * juce::jlimit(0.0f, 1.0f, load); };
+
+  g.fillAll(juce::Colours::aquamarine.brighter().brighter());
+
+  // over half the budget leaves the host little room, over all of it is a dropout
+  const auto colour = statistics.p99 > 1.0f   ? juce::Colours::red
+                      : statistics.p99 > 0.5f ? juce::Colours::orange
+                                              : juce::Colours::aquamarine.darker();
+
+  g.setColour(colour.withAlpha(0.3f));
+  g.fillRect(bounds);
+  g.setColour(colour);
+  g.fillRect(bounds.toFloat().withWidth(toWidth(statistics.p99)));
+  g.fillRect(bounds.toFloat().withX((float)bounds.getX() + toWidth(statistics.max) - 1.0f).withWidth(2.0f));
+
+  g.setColour(juce::Colours::black);
+  g.setFont(12.0f);
+  g.drawFittedText(juce::String::formatted("p50 %.0f%%  p99 %.0f%%  max %.0f%%  overruns %lld",
+                                           100.0f * statistics.p50, 100.0f * statistics.p99, 100.0f * statistics.max,
+                                           (long long)statistics.numOverruns),
+                   text.withTrimmedLeft(6), juce::Justification::centredLeft, 1);
+}
+
 //==============================================================================
 ReverbProjectAudioProcessorEditor::ReverbProjectAudioProcessorEditor(ReverbProjectAudioProcessor &p)
-    : AudioProcessorEditor(&p), audioProcessor(p)
+    : AudioProcessorEditor(&p), audioProcessor(p), parameterEditor(p), loadMeter(p)
 {
+  addAndMakeVisible(parameterEditor);
+  addAndMakeVisible(loadMeter);
+
   // Make sure that before the constructor has finished, you've set the
   // editor's size to whatever you need it to be.
-  setSize(400, 300);
+  setSize(parameterEditor.getWidth(), parameterEditor.getHeight() + meterHeight);
 }
 
 ReverbProjectAudioProcessorEditor::~ReverbProjectAudioProcessorEditor()
@@ -26,16 +70,12 @@ ReverbProjectAudioProcessorEditor::~ReverbProjectAudioProcessorEditor()
 void ReverbProjectAudioProcessorEditor::paint(juce::Graphics &g)
 {
   // (Our component is opaque, so we must completely fill the background with a solid colour)
-  // g.fillAll(getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId));
-  g.fillAll(juce::Colours::aquamarine.brighter().brighter());
-
-  g.setColour(juce::Colours::aquamarine.darker());
-  g.setFont(20.0f);
-  g.drawFittedText("Reverbbberations", getLocalBounds(), juce::Justification::centredTop, 1);
+  g.fillAll(getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId));
 }
 
 void ReverbProjectAudioProcessorEditor::resized()
 {
-  // This is generally where you'll want to lay out the positions of any
-  // subcomponents in your editor..
+  auto bounds = getLocalBounds();
+  loadMeter.setBounds(bounds.removeFromBottom(meterHeight));
+  parameterEditor.setBounds(bounds);
 }
@@ -13,6 +13,29 @@
 
 //==============================================================================
 /**
+    Shows how much of each block's real-time budget the processor takes: a bar for the 99th
+    percentile with a tick at the maximum, and the figures next to it. Polls a few times a second.
+ */
+class LoadMeter : public juce::Component,
+                  private juce::Timer
+{
+public:
+  explicit LoadMeter(const ReverbProjectAudioProcessor &);
+
+  void paint(juce::Graphics &) override;
+
+private:
+  void timerCallback() override;
+
+  const ReverbProjectAudioProcessor &audioProcessor;
+  LoadMonitor::Statistics statistics;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LoadMeter)
+};
+
+//==============================================================================
+/**
+    The generic parameter editor, with a load meter underneath.
  */
 class ReverbProjectAudioProcessorEditor : public juce::AudioProcessorEditor
 {
@@ -29,5 +52,10 @@ private:
   // access the processor object that created it.
   ReverbProjectAudioProcessor &audioProcessor;
 
+  juce::GenericAudioProcessorEditor parameterEditor;
+  LoadMeter loadMeter;
+
+  static constexpr int meterHeight = 24;
+
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ReverbProjectAudioProcessorEditor)
 };
@@ -21,19 +21,7 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
-
-namespace ParamIDs
-{
-
-    inline constexpr auto size{"size"};
-    inline constexpr auto damp{"damp"};
-    inline constexpr auto width{"width"};
-    inline constexpr auto mix{"mix"};
-    inline constexpr auto freeze{"freeze"};
-    inline constexpr auto diffFeedbck{"diffFeedbck"};
-    // inline constexpr auto color{"color"};
-
-}
+#include "RealtimeGuard.h"
 
 static juce::AudioProcessorValueTreeState::ParameterLayout createParamLayout()
 {
@@ -93,10 +81,43 @@ static juce::AudioProcessorValueTreeState::ParameterLayout createParamLayout()
                                                            percent,
                                                            nullptr));
 
+    layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID{ParamIDs::modDepth, 1},
+                                                           ParamIDs::modDepth,
+                                                           juce::NormalisableRange<float>{0.0f, 100.0f, 0.01f, 1.0f},
+                                                           0.0f,
+                                                           juce::String(),
+                                                           juce::AudioProcessorParameter::genericParameter,
+                                                           percent,
+                                                           nullptr));
+
+    layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID{ParamIDs::modRate, 1},
+                                                           ParamIDs::modRate,
+                                                           juce::NormalisableRange<float>{0.1f, 3.0f, 0.01f, 0.5f},
+                                                           0.5f,
+                                                           juce::String(),
+                                                           juce::AudioProcessorParameter::genericParameter,
+                                                           [](float val, int)
+                                                           { return juce::String(val, 2) + " Hz"; },
+                                                           nullptr));
+
+    layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID{ParamIDs::early, 1},
+                                                           ParamIDs::early,
+                                                           juce::NormalisableRange<float>{0.0f, 100.0f, 0.01f, 1.0f},
+                                                           0.0f,
+                                                           juce::String(),
+                                                           juce::AudioProcessorParameter::genericParameter,
+                                                           percent,
+                                                           nullptr));
+
     layout.add(std::make_unique<juce::AudioParameterBool>(juce::ParameterID{ParamIDs::freeze, 1},
                                                           ParamIDs::freeze,
                                                           false));
 
+    layout.add(std::make_unique<juce::AudioParameterChoice>(juce::ParameterID{ParamIDs::engine, 1},
+                                                            ParamIDs::engine,
+                                                            getEngineNames(),
+                                                            0));
+
     // Choice parameter. Could be used for sound "color" selection.
     // juce::StringArray stringArray;
     // juce::String str;
@@ -136,6 +157,9 @@ ReverbProjectAudioProcessor::ReverbProjectAudioProcessor()
     storeFloatParam(width, ParamIDs::width);
     storeFloatParam(mix, ParamIDs::mix);
     storeFloatParam(diffFeedbck, ParamIDs::diffFeedbck);
+    storeFloatParam(modDepth, ParamIDs::modDepth);
+    storeFloatParam(modRate, ParamIDs::modRate);
+    storeFloatParam(early, ParamIDs::early);
 
     auto storeBoolParam = [&apvts = this->apvts](auto &param, const auto &paramID)
     {
@@ -145,6 +169,12 @@ ReverbProjectAudioProcessor::ReverbProjectAudioProcessor()
 
     storeBoolParam(freeze, ParamIDs::freeze);
 
+    engine = dynamic_cast<juce::AudioParameterChoice *>(apvts.getParameter(ParamIDs::engine));
+    jassert(engine != nullptr);
+
+    for (auto *paramID : ParamIDs::all)
+        apvts.addParameterListener(paramID, this);
+
     // auto storeChoiceParam = [&apvts = this->apvts](auto &param, const auto &paramID)
     // {
     //     param = dynamic_cast<juce::AudioParameterChoice *>(apvts.getParameter(paramID));
@@ -156,6 +186,8 @@ ReverbProjectAudioProcessor::ReverbProjectAudioProcessor()
 
 ReverbProjectAudioProcessor::~ReverbProjectAudioProcessor()
 {
+    for (auto *paramID : ParamIDs::all)
+        apvts.removeParameterListener(paramID, this);
 }
 
 //==============================================================================
@@ -193,27 +225,34 @@ bool ReverbProjectAudioProcessor::isMidiEffect() const
 
 double ReverbProjectAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    return engines.getTailLengthSeconds();
 }
 
 int ReverbProjectAudioProcessor::getNumPrograms()
 {
-    return 1; // NB: some hosts don't cope very well if you tell them there are 0 programs,
-              // so this should be at least 1, even if you're not really implementing programs.
+    return numFactoryPrograms;
 }
 
 int ReverbProjectAudioProcessor::getCurrentProgram()
 {
-    return 0;
+    return currentProgram;
 }
 
 void ReverbProjectAudioProcessor::setCurrentProgram(int index)
 {
+    if (!juce::isPositiveAndBelow(index, numFactoryPrograms))
+        return;
+
+    currentProgram = index;
+    setParameterValues(factoryPrograms[index].values);
+
+    // the factory programs have no response, so none is carried over from before
+    clearImpulseResponse();
 }
 
 const juce::String ReverbProjectAudioProcessor::getProgramName(int index)
 {
-    return {};
+    return juce::isPositiveAndBelow(index, numFactoryPrograms) ? factoryPrograms[index].name : juce::String();
 }
 
 void ReverbProjectAudioProcessor::changeProgramName(int index, const juce::String &newName)
@@ -221,6 +260,43 @@ void ReverbProjectAudioProcessor::changeProgramName(int index, const juce::Strin
 }
 
 //==============================================================================
+/** Sorts a speaker into the side of the reverb that feeds it; height and centre speakers follow
+    their side, the LFE stays dry.
+*/
+static ReverbEngines::ChannelPosition getChannelPosition(const juce::AudioChannelSet::ChannelType type)
+{
+    using Set = juce::AudioChannelSet;
+
+    switch (type)
+    {
+    case Set::left:
+    case Set::leftCentre:
+    case Set::leftSurround:
+    case Set::leftSurroundSide:
+    case Set::leftSurroundRear:
+    case Set::wideLeft:
+    case Set::topFrontLeft:
+    case Set::topSideLeft:
+    case Set::topRearLeft:
+        return ReverbEngines::ChannelPosition::left;
+    case Set::right:
+    case Set::rightCentre:
+    case Set::rightSurround:
+    case Set::rightSurroundSide:
+    case Set::rightSurroundRear:
+    case Set::wideRight:
+    case Set::topFrontRight:
+    case Set::topSideRight:
+    case Set::topRearRight:
+        return ReverbEngines::ChannelPosition::right;
+    case Set::LFE:
+    case Set::LFE2:
+        return ReverbEngines::ChannelPosition::lfe;
+    default:
+        return ReverbEngines::ChannelPosition::centre;
+    }
+}
+
 void ReverbProjectAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
     // Use this method as the place to do any pre-playback
@@ -232,12 +308,34 @@ void ReverbProjectAudioProcessor::prepareToPlay(double sampleRate, int samplesPe
     specs.maximumBlockSize = static_cast<juce::uint32>(samplesPerBlock);
     specs.numChannels = static_cast<juce::uint32>(getTotalNumOutputChannels());
 
-#if MYVERS
-    r3.setSampleRate(sampleRate);
+    // the engines are prepared afresh, so the first values they get apply at once
+    hasAppliedValues = false;
+    parametersChanged.store(true, std::memory_order_release);
 
-#elif !MYVERS
-    r2.setSampleRate(specs.sampleRate);
-#endif
+    loadMonitor.setSampleRate(sampleRate);
+    loadMonitor.reset();
+
+    {
+        // the convolution engine must not be reallocated while a response is being prepared for it
+        const juce::ScopedLock sl(impulseLock);
+        auto &convolution = engines.getConvolution();
+        convolution.setHeadSize((int)apvts.state.getProperty(StateIDs::convolutionHeadSize, convolution.getHeadSize()));
+
+        engines.setDownsampling((bool)apvts.state.getProperty(StateIDs::downsampling, false));
+        engines.setSampleRate(sampleRate);
+    }
+
+    const auto layout = getBusesLayout().getMainOutputChannelSet();
+    ReverbEngines::ChannelPosition positions[ReverbEngines::maximumChannels];
+    const int numChannels = juce::jmin(layout.size(), ReverbEngines::maximumChannels);
+
+    for (int c = 0; c < numChannels; ++c)
+        positions[c] = getChannelPosition(layout.getTypeOfChannel(c));
+
+    engines.setChannelLayout(positions, numChannels);
+
+    // a new sample rate drops the prepared response
+    updateImpulseResponse();
 }
 
 void ReverbProjectAudioProcessor::releaseResources()
@@ -253,12 +351,16 @@ bool ReverbProjectAudioProcessor::isBusesLayoutSupported(const BusesLayout &layo
     juce::ignoreUnused(layouts);
     return true;
 #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    // Some plugin hosts, such as certain GarageBand versions, will only
-    // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono() && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
-        return false;
+    // Mono, stereo, and speaker layouts up to 16 channels such as 5.1, 7.1 and 7.1.4;
+    // ambisonics and unnamed discrete channels have no speaker positions to spread the reverb over.
+    const auto &output = layouts.getMainOutputChannelSet();
+
+    if (output != juce::AudioChannelSet::mono() && output != juce::AudioChannelSet::stereo())
+    {
+        if (output.size() > ReverbEngines::maximumChannels || output.isDiscreteLayout()
+            || output.getAmbisonicOrder() >= 0 || output.isDisabled())
+            return false;
+    }
 
         // This checks if the input layout matches the output layout
 #if !JucePlugin_IsSynth
@@ -271,24 +373,56 @@ bool ReverbProjectAudioProcessor::isBusesLayoutSupported(const BusesLayout &layo
 }
 #endif
 
-void ReverbProjectAudioProcessor::updateReverbParams()
+PluginParameterValues ReverbProjectAudioProcessor::getParameterValues() const
+{
+    PluginParameterValues values;
+    values.size = size->get();
+    values.damp = damp->get();
+    values.width = width->get();
+    values.mix = mix->get();
+    values.diffFeedbck = diffFeedbck->get();
+    values.modDepth = modDepth->get();
+    values.modRate = modRate->get();
+    values.early = early->get();
+    values.freeze = freeze->get();
+    values.engine = (EngineType)engine->getIndex();
+    return values;
+}
+
+void ReverbProjectAudioProcessor::setParameterValues(const PluginParameterValues &values)
+{
+    // each parameter tells the host and raises parametersChanged, as if the user had moved it
+    auto set = [](juce::RangedAudioParameter *param, const float value)
+    { param->setValueNotifyingHost(param->convertTo0to1(value)); };
+
+    set(size, values.size);
+    set(damp, values.damp);
+    set(width, values.width);
+    set(mix, values.mix);
+    set(diffFeedbck, values.diffFeedbck);
+    set(modDepth, values.modDepth);
+    set(modRate, values.modRate);
+    set(early, values.early);
+    set(freeze, values.freeze ? 1.0f : 0.0f);
+    set(engine, (float)(int)values.engine);
+}
+
+void ReverbProjectAudioProcessor::applyParameterValues(const PluginParameterValues &values)
 {
-    params.roomSize = size->get() * 0.01f;
-    params.damping = damp->get() * 0.01f;
-    params.width = width->get() * 0.01f;
-    params.wetLevel = mix->get() * 0.01f;
-    params.dryLevel = 1.0f - mix->get() * 0.01f;
-    params.freezeMode = freeze->get();
+    // the idle engines follow along, so whichever is chosen next starts from the right settings
+    engines.setParameters(values.toReverbParameters());
 
-#if MYVERS
-    params.diffusionFeedback = diffFeedbck->get() * 0.01f;
-    r3.setParameters(params);
+    // a switch crossfades, so automating the engine does not click
+    engines.setEngine(values.engine);
 
     // params.color = color;
+}
 
-#elif !MYVERS
-    r2.setParameters(params);
-#endif
+void ReverbProjectAudioProcessor::parameterChanged(const juce::String &, float)
+{
+    // This can arrive on the message thread or the audio thread, so it only raises a flag.
+    // The audio thread rebuilds the reverb parameters the next time it sees it set.
+    parametersChanged.store(true, std::memory_order_release);
 }
 
 // Settings getSettings(juce::AudioProcessorValueTreeState &vts)
@@ -302,6 +436,21 @@ void ReverbProjectAudioProcessor::updateReverbParams()
 
 void ReverbProjectAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages)
 {
+    juce::ignoreUnused(midiMessages);
+    process(buffer);
+}
+
+void ReverbProjectAudioProcessor::processBlock(juce::AudioBuffer<double> &buffer, juce::MidiBuffer &midiMessages)
+{
+    juce::ignoreUnused(midiMessages);
+    process(buffer);
+}
+
+template <typename SampleType>
+void ReverbProjectAudioProcessor::process(juce::AudioBuffer<SampleType> &buffer)
+{
+    const RealtimeGuard::ScopedRealtime realtime("processBlock");
+    const LoadMonitor::ScopedBlock timing(loadMonitor, buffer.getNumSamples());
     juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
@@ -309,43 +458,74 @@ void ReverbProjectAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer,
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear(i, 0, buffer.getNumSamples());
 
-    updateReverbParams();
+    // When nothing has changed this costs a single atomic load. JUCE passes on a host change
+    // without its position in the block, so rather than jump at the start of the block, the
+    // change is ramped across it and the block is split at each step.
+    if (parametersChanged.load(std::memory_order_relaxed) && parametersChanged.exchange(false, std::memory_order_acquire))
+    {
+        const auto values = getParameterValues();
+
+        if (hasAppliedValues)
+            parameterEvents.addRamp(appliedValues, values, buffer.getNumSamples());
+        else
+            parameterEvents.add(0, values);
+
+        appliedValues = values;
+        hasAppliedValues = true;
+    }
 
-    juce::dsp::AudioBlock<float> block(buffer);
-    juce::dsp::ProcessContextReplacing<float> ctx(block);
+    juce::dsp::AudioBlock<SampleType> block(buffer);
+    juce::dsp::ProcessContextReplacing<SampleType> ctx(block);
 
-    const auto &inputBlock = ctx.getInputBlock();
+    // the context replaces, so input and output are the same channels and the engines process
+    // them in place, with nothing to copy first
     auto &outputBlock = ctx.getOutputBlock();
-    const auto numInChannels = inputBlock.getNumChannels();
-    const auto numOutChannels = outputBlock.getNumChannels();
     const auto numSamples = outputBlock.getNumSamples();
 
-    jassert(inputBlock.getNumSamples() == numSamples);
-
-    outputBlock.copyFrom(inputBlock);
-
     if (ctx.isBypassed)
+    {
+        // changes are still applied, so the engines are up to date when processing resumes
+        if (!parameterEvents.isEmpty())
+            applyParameterValues(appliedValues);
+
+        parameterEvents.clear();
         return;
+    }
 
-    if (numInChannels == 1 && numOutChannels == 1)
+    // each stretch between changes runs on constant parameters
+    parameterEvents.processSubBlocks(
+        (int)numSamples,
+        [this](const PluginParameterValues &values)
+        { applyParameterValues(values); },
+        [this, &outputBlock](const int start, const int length)
+        { processSubBlock(outputBlock, start, length); });
+
+    parameterEvents.clear();
+}
+
+template <typename SampleType>
+void ReverbProjectAudioProcessor::processSubBlock(juce::dsp::AudioBlock<SampleType> &block, const int start, const int numSamples)
+{
+    const auto numChannels = block.getNumChannels();
+
+    if (numChannels == 1)
     {
-#if MYVERS
-        r3.processMono(outputBlock.getChannelPointer(0), (int)numSamples);
-#elif !MYVERS
-        // r2.processMono(outputBlock.getChannelPointer(0), (int)numSamples);
-#endif
+        engines.processMono(block.getChannelPointer(0) + start, numSamples);
     }
-    else if (numInChannels == 2 && numOutChannels == 2)
+    else if (numChannels == 2)
     {
-#if MYVERS
-        r3.processStereo(outputBlock.getChannelPointer(0),
-                         outputBlock.getChannelPointer(1),
-                         (int)numSamples);
-#elif !MYVERS
-        r2.processStereo(outputBlock.getChannelPointer(0),
-                         outputBlock.getChannelPointer(1),
-                         (int)numSamples);
-#endif
+        engines.processStereo(block.getChannelPointer(0) + start,
+                              block.getChannelPointer(1) + start,
+                              numSamples);
+    }
+    else if (numChannels <= (size_t)ReverbEngines::maximumChannels)
+    {
+        SampleType *channels[ReverbEngines::maximumChannels];
+
+        for (size_t c = 0; c < numChannels; ++c)
+            channels[c] = block.getChannelPointer(c) + start;
+
+        engines.processMultichannel(channels, (int)numChannels, numSamples);
     }
     else
     {
@@ -361,27 +541,132 @@ bool ReverbProjectAudioProcessor::hasEditor() const
 
 juce::AudioProcessorEditor *ReverbProjectAudioProcessor::createEditor()
 {
-    // return new ReverbProjectAudioProcessorEditor (*this);
-    return new juce::GenericAudioProcessorEditor(*this);
+    return new ReverbProjectAudioProcessorEditor(*this);
 }
 
 //==============================================================================
 void ReverbProjectAudioProcessor::getStateInformation(juce::MemoryBlock &destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
-    juce::MemoryOutputStream mos(destData, true);
-    apvts.state.writeToStream(mos);
+    // a fixed binary record rather than the parameter tree, so a session with many instances
+    // saves and loads without building and parsing a tree for each; see PluginState
+    PluginState state;
+    state.values = getParameterValues();
+    state.downsampling = (bool)apvts.state.getProperty(StateIDs::downsampling, false);
+    state.convolutionHeadSize = (int)apvts.state.getProperty(StateIDs::convolutionHeadSize, 0);
+    state.program = currentProgram;
+    state.impulseResponse = apvts.state.getProperty(StateIDs::impulseResponse).toString();
+    state.write(destData);
 }
 
 void ReverbProjectAudioProcessor::setStateInformation(const void *data, int sizeInBytes)
 {
+    PluginState state;
+
+    // sessions saved by earlier versions hold the parameter tree, which PluginState reads too
+    if (!state.read(data, (size_t)juce::jmax(0, sizeInBytes)))
+        return;
+
+    currentProgram = state.program;
+    setParameterValues(state.values);
+
+    // these lay out memory again or read a file, so they only happen when something changed
+    if (state.downsampling != (bool)apvts.state.getProperty(StateIDs::downsampling, false))
+        setDownsampling(state.downsampling);
+
+    if (state.convolutionHeadSize > 0 && state.convolutionHeadSize != engines.getConvolution().getHeadSize())
+        setConvolutionHeadSize(state.convolutionHeadSize);
+
+    // a state without a response recalls a silent convolution engine, not whatever was loaded before
+    if (state.impulseResponse.isEmpty())
+        clearImpulseResponse();
+    else if (state.impulseResponse != apvts.state.getProperty(StateIDs::impulseResponse).toString())
+        loadImpulseResponse(juce::File(state.impulseResponse));
+}
+
+//==============================================================================
+bool ReverbProjectAudioProcessor::loadImpulseResponse(const juce::File &file)
+{
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+
+    std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(file));
+
+    if (reader == nullptr || reader->lengthInSamples <= 0)
+        return false;
+
+    juce::AudioBuffer<float> source((int)juce::jmin(2u, reader->numChannels),
+                                    (int)juce::jmin(reader->lengthInSamples, (juce::int64)std::numeric_limits<int>::max()));
+    reader->read(&source, 0, source.getNumSamples(), 0, true, true);
+
+    {
+        const juce::ScopedLock sl(impulseLock);
+        impulseSource = std::move(source);
+        impulseSourceSampleRate = reader->sampleRate;
+    }
+
+    apvts.state.setProperty(StateIDs::impulseResponse, file.getFullPathName(), nullptr);
+    updateImpulseResponse();
+    return true;
+}
+
+void ReverbProjectAudioProcessor::clearImpulseResponse()
+{
+    {
+        const juce::ScopedLock sl(impulseLock);
+        impulseSource.setSize(0, 0);
+        impulseSourceSampleRate = 0;
+        engines.getConvolution().setImpulseResponse(nullptr);
+    }
+
+    apvts.state.removeProperty(StateIDs::impulseResponse, nullptr);
+}
+
+void ReverbProjectAudioProcessor::setConvolutionHeadSize(const int headSize)
+{
+    apvts.state.setProperty(StateIDs::convolutionHeadSize, headSize, nullptr);
+
+    suspendProcessing(true);
+
+    {
+        const juce::ScopedLock sl(impulseLock);
+        engines.getConvolution().setHeadSize(headSize);
+    }
+
+    updateImpulseResponse();
+    suspendProcessing(false);
+}
+
+void ReverbProjectAudioProcessor::setDownsampling(const bool shouldDownsample)
+{
+    apvts.state.setProperty(StateIDs::downsampling, shouldDownsample, nullptr);
+
+    // this lays out the delay lines again, so the audio thread has to stay out
+    suspendProcessing(true);
+    engines.setDownsampling(shouldDownsample);
+    suspendProcessing(false);
+}
+
+void ReverbProjectAudioProcessor::updateImpulseResponse()
+{
+    const juce::ScopedLock sl(impulseLock);
+    auto &convolution = engines.getConvolution();
+
+    if (impulseSource.getNumSamples() <= 0)
+        return;
+
+    auto ir = convolution.prepareImpulseResponse(impulseSource, impulseSourceSampleRate);
 
-    auto valueTree = juce::ValueTree::readFromData(data, static_cast<size_t>(sizeInBytes));
+    if (!convolution.hasHistoryFor(*ir))
+    {
+        // the input history is laid out for this response alone, so the audio thread has to
+        // stay out while it is allocated again
+        const bool wasSuspended = isSuspended();
+        suspendProcessing(true);
+        convolution.allocateHistoryFor(*ir);
+        suspendProcessing(wasSuspended);
+    }
 
-    if (valueTree.isValid())
-        apvts.replaceState(valueTree);
+    convolution.setImpulseResponse(std::move(ir));
 }
 
 //==============================================================================
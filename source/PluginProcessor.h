@@ -22,7 +22,10 @@
 #pragma once
 
 #include <JuceHeader.h>
-#include "ReverbFX.h"
+#include "ReverbEngines.h"
+#include "ReverbState.h"
+#include "ParameterEvents.h"
+#include "LoadMonitor.h"
 
 // @TODO remove JuceHeader and only add classes that you will need:
 // #include <juce_audio_processors/juce_audio_processors.h>
@@ -30,12 +33,11 @@
 // #include <juce_audio_basics/juce_audio_basics.h>
 // #include <juce_gui_basics/juce_gui_basics.h>
 
-#define MYVERS 1 // toggles between juce::reverb and my modified version, for comparasing
-
 //==============================================================================
 /**
  */
-class ReverbProjectAudioProcessor : public juce::AudioProcessor
+class ReverbProjectAudioProcessor : public juce::AudioProcessor,
+                                    private juce::AudioProcessorValueTreeState::Listener
 {
 public:
   //==============================================================================
@@ -51,6 +53,10 @@ public:
 #endif
 
   void processBlock(juce::AudioBuffer<float> &, juce::MidiBuffer &) override;
+  void processBlock(juce::AudioBuffer<double> &, juce::MidiBuffer &) override;
+
+  /** ReverbFX runs double buffers as they are; see ReverbEngines. */
+  bool supportsDoublePrecisionProcessing() const override { return true; }
 
   //==============================================================================
   juce::AudioProcessorEditor *createEditor() override;
@@ -75,6 +81,35 @@ public:
   void getStateInformation(juce::MemoryBlock &destData) override;
   void setStateInformation(const void *data, int sizeInBytes) override;
 
+  //==============================================================================
+  /** Loads the response the convolution engine plays, and remembers it in the state.
+      Reading and preparing the file happens on the calling thread, never the audio thread.
+  */
+  bool loadImpulseResponse(const juce::File &file);
+
+  /** Drops the response the convolution engine plays, which then stays silent, and forgets it
+      in the state.
+  */
+  void clearImpulseResponse();
+
+  /** Sets how much of the response the convolution engine applies without FFTs; see
+      ConvolutionReverb::setHeadSize. This briefly suspends processing.
+  */
+  void setConvolutionHeadSize(int headSize);
+
+  /** Runs the network at a lower internal rate in high sample rate sessions, to save CPU;
+      see ReverbFX::setDownsampling. This briefly suspends processing.
+  */
+  void setDownsampling(bool shouldDownsample);
+
+  /** Returns the share of real time an engine takes per block, measured the last time it ran. */
+  float getEngineCpuLoad(EngineType engine) const noexcept { return engines.getCpuLoad(engine); }
+
+  /** Returns how much of each block's real-time budget processBlock took, over the most recent
+      blocks, and how many blocks overran it. Safe to call from any thread but the audio thread.
+  */
+  LoadMonitor::Statistics getLoadStatistics() const noexcept { return loadMonitor.getStatistics(); }
+
 private:
   juce::AudioProcessorValueTreeState apvts;
 
@@ -84,19 +119,51 @@ private:
   juce::AudioParameterFloat *mix{nullptr};
   juce::AudioParameterBool *freeze{nullptr};
   juce::AudioParameterFloat *diffFeedbck{nullptr};
+  juce::AudioParameterFloat *modDepth{nullptr};
+  juce::AudioParameterFloat *modRate{nullptr};
+  juce::AudioParameterFloat *early{nullptr};
+  juce::AudioParameterChoice *engine{nullptr};
   // juce::AudioParameterChoice *color{nullptr};
 
-  void updateReverbParams();
+  PluginParameterValues getParameterValues() const;
+  void setParameterValues(const PluginParameterValues &values);
+  void applyParameterValues(const PluginParameterValues &values);
+  void parameterChanged(const juce::String &parameterID, float newValue) override;
 
-#if MYVERS
-  using Parameters = ReverbFX::Parameters;
-  Parameters params;
-  ReverbFX r3;
-#elif !MYVERS
+  // Both precisions of processBlock end up here
+  template <typename SampleType>
+  void process(juce::AudioBuffer<SampleType> &buffer);
 
-  juce::dsp::Reverb::Parameters params;
-  juce::Reverb r2;
-#endif
+  // Runs the engines over one stretch of the block, between parameter changes
+  template <typename SampleType>
+  void processSubBlock(juce::dsp::AudioBlock<SampleType> &block, int start, int numSamples);
+
+  // Set by the parameter listener from any thread, consumed by the audio thread.
+  std::atomic<bool> parametersChanged{true};
+
+  // The index into factoryPrograms last chosen, or restored with the state
+  int currentProgram{0};
+
+  // The parameter changes of the block being processed, each at its sample offset
+  ParameterEventList parameterEvents;
+
+  // The values the engines were last given, which a host change ramps from. Until the first
+  // block after prepareToPlay there is nothing to ramp from.
+  PluginParameterValues appliedValues;
+  bool hasAppliedValues{false};
+
+  // All engines are allocated up front; the engine parameter picks the one that runs
+  ReverbEngines engines;
+
+  // Times every processBlock against the duration of its block
+  LoadMonitor loadMonitor;
+
+  // The response as loaded, kept to prepare it again when the sample rate changes
+  juce::AudioBuffer<float> impulseSource;
+  double impulseSourceSampleRate{0};
+  juce::CriticalSection impulseLock;
+
+  void updateImpulseResponse();
 
   juce::UndoManager undoManager;
   //==============================================================================
@@ -0,0 +1,201 @@
+/*
+  ==============================================================================
+
+   Copyright 2023, 2024 Vitalii Voronkin
+
+   Reverb Project is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Reverb Project is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Simple Reverb. If not, see <http://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "RealtimeGuard.h"
+
+#if REVERB_RT_GUARD
+
+#include <cstdlib>
+#include <new>
+
+// The hooks replace the allocator and mutex functions of the whole executable, so they only
+// work when linked into one (RealtimeCheck, the Standalone). In a plugin binary the host's
+// functions usually win, and the scopes then count nothing.
+
+#if defined(__GLIBC__)
+#include <dlfcn.h>
+#include <pthread.h>
+
+extern "C"
+{
+    void *__libc_malloc(size_t);
+    void *__libc_calloc(size_t, size_t);
+    void *__libc_realloc(void *, size_t);
+    void *__libc_memalign(size_t, size_t);
+    void __libc_free(void *);
+}
+
+#define REVERB_RT_GUARD_GLIBC 1
+#else
+#define REVERB_RT_GUARD_GLIBC 0
+#endif
+
+using RealtimeGuard::Violation;
+
+namespace
+{
+    // With glibc, malloc and free are replaced too, and operator new must not report twice
+    void *rawAllocate(const size_t size) noexcept
+    {
+#if REVERB_RT_GUARD_GLIBC
+        return __libc_malloc(size);
+#else
+        return std::malloc(size);
+#endif
+    }
+
+    void *rawAllocateAligned(const size_t size, const size_t alignment) noexcept
+    {
+#if REVERB_RT_GUARD_GLIBC
+        return __libc_memalign(alignment, size);
+#elif JUCE_WINDOWS
+        return _aligned_malloc(size, alignment);
+#else
+        return std::aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+#endif
+    }
+
+    void rawFree(void *const pointer) noexcept
+    {
+#if REVERB_RT_GUARD_GLIBC
+        __libc_free(pointer);
+#else
+        std::free(pointer);
+#endif
+    }
+
+    void rawFreeAligned(void *const pointer) noexcept
+    {
+#if JUCE_WINDOWS && !REVERB_RT_GUARD_GLIBC
+        _aligned_free(pointer);
+#else
+        rawFree(pointer);
+#endif
+    }
+}
+
+bool RealtimeGuard::canDetectLocks() noexcept
+{
+    return REVERB_RT_GUARD_GLIBC != 0;
+}
+
+//==============================================================================
+// The array and nothrow forms of the standard library all end up in these.
+void *operator new(const size_t size)
+{
+    RealtimeGuard::report(Violation::allocation);
+
+    if (auto *pointer = rawAllocate(size != 0 ? size : 1))
+        return pointer;
+
+    throw std::bad_alloc();
+}
+
+void *operator new(const size_t size, const std::align_val_t alignment)
+{
+    RealtimeGuard::report(Violation::allocation);
+
+    if (auto *pointer = rawAllocateAligned(size != 0 ? size : 1, (size_t)alignment))
+        return pointer;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void *const pointer) noexcept
+{
+    if (pointer != nullptr)
+        RealtimeGuard::report(Violation::deallocation);
+
+    rawFree(pointer);
+}
+
+void operator delete(void *const pointer, std::align_val_t) noexcept
+{
+    if (pointer != nullptr)
+        RealtimeGuard::report(Violation::deallocation);
+
+    rawFreeAligned(pointer);
+}
+
+void operator delete(void *const pointer, size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete(void *const pointer, size_t, const std::align_val_t alignment) noexcept
+{
+    operator delete(pointer, alignment);
+}
+
+//==============================================================================
+#if REVERB_RT_GUARD_GLIBC
+
+// glibc lets an executable replace malloc, which catches HeapBlock and everything else that
+// bypasses operator new, and pthread_mutex_lock, which std::mutex and CriticalSection go through.
+extern "C"
+{
+    void *malloc(const size_t size)
+    {
+        RealtimeGuard::report(Violation::allocation);
+        return __libc_malloc(size);
+    }
+
+    void *calloc(const size_t count, const size_t size)
+    {
+        RealtimeGuard::report(Violation::allocation);
+        return __libc_calloc(count, size);
+    }
+
+    void *realloc(void *const pointer, const size_t size)
+    {
+        RealtimeGuard::report(Violation::allocation);
+        return __libc_realloc(pointer, size);
+    }
+
+    void free(void *const pointer)
+    {
+        if (pointer != nullptr)
+            RealtimeGuard::report(Violation::deallocation);
+
+        __libc_free(pointer);
+    }
+
+    int pthread_mutex_lock(pthread_mutex_t *const mutex)
+    {
+        // a function-local static would take a lock of its own to initialise
+        using LockFunction = int (*)(pthread_mutex_t *);
+        static std::atomic<LockFunction> next{nullptr};
+        auto lock = next.load(std::memory_order_relaxed);
+
+        if (lock == nullptr)
+        {
+            lock = (LockFunction)dlsym(RTLD_NEXT, "pthread_mutex_lock");
+            next.store(lock, std::memory_order_relaxed);
+        }
+
+        RealtimeGuard::report(Violation::lock);
+        return lock(mutex);
+    }
+}
+
+#endif
+
+#endif
@@ -0,0 +1,130 @@
+/*
+  ==============================================================================
+
+   Copyright 2023, 2024 Vitalii Voronkin
+
+   Reverb Project is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Reverb Project is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Simple Reverb. If not, see <http://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#ifndef REVERB_RT_GUARD
+#define REVERB_RT_GUARD 0
+#endif
+
+//==============================================================================
+/**
+    Catches the audio path allocating, freeing or locking a mutex.
+
+    Code that must stay real-time safe runs inside a ScopedRealtime. In builds with
+    REVERB_RT_GUARD=1, RealtimeGuard.cpp replaces operator new and delete and, with glibc, malloc,
+    free and pthread_mutex_lock, and every call made inside a scope on the same thread is counted
+    and, in debug builds, asserted. Otherwise a scope compiles to nothing.
+*/
+namespace RealtimeGuard
+{
+
+    /** What went wrong, for the counters and the report. */
+    enum class Violation
+    {
+        allocation,
+        deallocation,
+        lock,
+        numViolations
+    };
+
+#if REVERB_RT_GUARD
+
+    namespace detail
+    {
+        inline thread_local const char *currentScope = nullptr;
+        inline thread_local bool reporting = false;
+        inline std::atomic<int> counts[(int)Violation::numViolations]{};
+        inline std::atomic<const char *> firstScope{nullptr};
+    }
+
+    //==============================================================================
+    /** Marks the calling thread as real-time until it goes out of scope. Scopes nest, and the
+        innermost name is the one reported.
+    */
+    class ScopedRealtime
+    {
+    public:
+        explicit ScopedRealtime(const char *name) noexcept : previous(detail::currentScope)
+        {
+            detail::currentScope = name;
+        }
+
+        ~ScopedRealtime() noexcept { detail::currentScope = previous; }
+
+    private:
+        const char *previous;
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedRealtime)
+    };
+
+    /** Called by the hooks. Counts the violation if the calling thread is inside a scope. */
+    inline void report(const Violation violation) noexcept
+    {
+        if (detail::currentScope == nullptr || detail::reporting)
+            return;
+
+        // asserting may itself allocate or lock, which must not be reported again
+        detail::reporting = true;
+        detail::counts[(int)violation].fetch_add(1, std::memory_order_relaxed);
+
+        const char *expected = nullptr;
+        detail::firstScope.compare_exchange_strong(expected, detail::currentScope);
+
+        jassertfalse; // the audio path must not allocate, free or lock
+        detail::reporting = false;
+    }
+
+    inline int getCount(const Violation violation) noexcept { return detail::counts[(int)violation].load(); }
+
+    /** Returns the name of the scope the first violation happened in, or nullptr. */
+    inline const char *getFirstScope() noexcept { return detail::firstScope.load(); }
+
+    inline void resetCounts() noexcept
+    {
+        for (auto &count : detail::counts)
+            count.store(0);
+
+        detail::firstScope.store(nullptr);
+    }
+
+    /** True when the hooks for locks are compiled in, which needs glibc. */
+    bool canDetectLocks() noexcept;
+
+#else
+
+    class ScopedRealtime
+    {
+    public:
+        explicit ScopedRealtime(const char *) noexcept {}
+    };
+
+    inline void report(Violation) noexcept {}
+    inline int getCount(Violation) noexcept { return 0; }
+    inline const char *getFirstScope() noexcept { return nullptr; }
+    inline void resetCounts() noexcept {}
+    inline bool canDetectLocks() noexcept { return false; }
+
+#endif
+
+}
@@ -0,0 +1,723 @@
+/*
+  ==============================================================================
+
+   Copyright 2023, 2024 Vitalii Voronkin
+
+   Reverb Project is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Reverb Project is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Simple Reverb. If not, see <http://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "ReverbFX.h"
+#include "FDNReverb.h"
+#include "ConvolutionReverb.h"
+#include "Decorrelator.h"
+#include "ReverbState.h"
+
+//==============================================================================
+/**
+    Every reverb engine, allocated side by side, with one of them active at a time.
+
+    Choosing another engine crossfades to it with equal-power gains over crossfadeSeconds,
+    running both engines for that long; outside a switch only the active engine runs.
+    The time each engine takes is measured per block, so engines can be compared in place.
+
+    Once the input and the output have both stayed below silenceThresholdDb for long enough,
+    the active engine goes to sleep: blocks of silence then only get the dry gain. The engine is
+    cleared in the first of those blocks rather than on top of the one it last ran in, and that
+    clear only touches the lines and history in use. The first block with input in it wakes the
+    engine again.
+
+    Layouts wider than stereo share one stereo engine: every channel but the LFE feeds it, its
+    wet output goes to the first left and right channels as it is, and every other channel
+    gets its own Decorrelator on that output, so the cost barely grows with the channel count.
+
+    The process methods take float or double buffers. ReverbFX processes doubles as they are;
+    the other engines are float only, and get them converted a block at a time.
+*/
+class ReverbEngines
+{
+public:
+    //==============================================================================
+    using Parameters = ReverbFX::Parameters;
+
+    static constexpr double crossfadeSeconds = 0.05;
+
+    /** The level, relative to full scale, below which a block counts as silent. */
+    static constexpr float silenceThresholdDb = -100.0f;
+
+    /** How long a recursive engine has to stay silent before it sleeps. This is longer than any
+        of their delay lines, so everything still circulating has come out in that time.
+    */
+    static constexpr double sleepHoldSeconds = 0.2;
+    static constexpr int numEngines = (int)EngineType::juceReverb + 1;
+
+    /** Where a channel of a multichannel layout sits, which decides what feeds it. */
+    enum class ChannelPosition
+    {
+        left,
+        right,
+        centre,
+        lfe
+    };
+
+    static constexpr int maximumChannels = Decorrelator::maximumIndex;
+
+    ReverbEngines() = default;
+
+    //==============================================================================
+    /** Prepares every engine for a sample rate. This allocates and clears them all. */
+    void setSampleRate(const double sampleRate)
+    {
+        jassert(sampleRate > 0);
+
+        currentSampleRate = sampleRate;
+
+        forEachEngine([sampleRate](auto &reverb)
+                      { reverb.setSampleRate(sampleRate); });
+
+        prepareDecorrelators();
+
+        multichannelDryGain.reset(sampleRate, 0.01);
+
+        finishCrossfade();
+        reset();
+    }
+
+    /** Clears the buffers of every engine. */
+    void reset()
+    {
+        forEachEngine([](auto &reverb)
+                      { reverb.reset(); });
+
+        for (int i = 0; i < numDecorrelators; ++i)
+            decorrelators[i].reset();
+
+        sleeping = needsClearing = false;
+        numSilentSamples = 0;
+    }
+
+    /** Passes the parameters to every engine, so an idle one starts from the right settings. */
+    void setParameters(const Parameters &params)
+    {
+        // with more than two channels the engines only make the wet signal, and the dry one
+        // is added per channel
+        auto engineParams = params;
+
+        if (numLayoutChannels > 2)
+            engineParams.dryLevel = 0.0f;
+
+        reverbFX.setWetOnly(numLayoutChannels > 2);
+
+        forEachEngine([&engineParams](auto &reverb)
+                      { applyParameters(reverb, engineParams); });
+
+        dryGain = ReverbFX::getCoefficients(engineParams).dryGain;
+        multichannelDryGain.setTargetValue(ReverbFX::getCoefficients(params).dryGain);
+        parameters = params;
+        updateTailLength();
+    }
+
+    /** Tells the engines what each channel of a layout wider than stereo is; see
+        processMultichannel. Mono and stereo need no layout. This allocates the decorrelators
+        the layout needs, so call it before processing.
+    */
+    void setChannelLayout(const ChannelPosition *positions, const int numChannels)
+    {
+        jassert(numChannels <= maximumChannels);
+
+        numLayoutChannels = jmin(numChannels, (int)maximumChannels);
+        int numFed = 0, nextDecorrelator = 0;
+        bool haveLeft = false, haveRight = false;
+
+        for (int c = 0; c < numLayoutChannels; ++c)
+        {
+            auto &channel = layout[c];
+            channel.position = positions[c];
+            channel.decorrelator = -1;
+
+            if (channel.position == ChannelPosition::lfe)
+                continue;
+
+            ++numFed;
+
+            // the first left and right keep the engine's own stereo image
+            if (channel.position == ChannelPosition::left && !haveLeft)
+                haveLeft = true;
+            else if (channel.position == ChannelPosition::right && !haveRight)
+                haveRight = true;
+            else
+                channel.decorrelator = nextDecorrelator++;
+        }
+
+        // uncorrelated channels add up in power, so this keeps the send at the level of a stereo pair
+        sendGain = numFed > 0 ? std::sqrt(2.0f / (float)numFed) : 0.0f;
+
+        numDecorrelators = nextDecorrelator;
+        prepareDecorrelators();
+
+        setParameters(parameters);
+        multichannelDryGain.setCurrentAndTargetValue(multichannelDryGain.getTargetValue());
+    }
+
+    //==============================================================================
+    /** Starts crossfading to another engine, from a cleared state. If a crossfade is still
+        running, the switch waits for it to finish. Call it from the audio thread.
+    */
+    void setEngine(const EngineType newEngine) noexcept
+    {
+        nextEngine = newEngine;
+
+        if (isCrossfading())
+            return;
+
+        if (newEngine == activeEngine)
+            return;
+
+        previousEngine = activeEngine;
+        activeEngine = newEngine;
+
+        withEngine(activeEngine, [](auto &reverb)
+                   { reverb.reset(); });
+
+        fadeLength = jmax(1, roundToInt(crossfadeSeconds * currentSampleRate));
+        fadePosition = 0;
+
+        updateTailLength();
+    }
+
+    EngineType getEngine() const noexcept { return activeEngine; }
+
+    bool isCrossfading() const noexcept { return fadePosition < fadeLength; }
+
+    /** Returns the share of real time an engine took per block, smoothed over recent blocks,
+        as of the last time it ran. Safe to call from any thread.
+    */
+    float getCpuLoad(const EngineType engine) const noexcept
+    {
+        return cpuLoads[(int)engine].load(std::memory_order_relaxed);
+    }
+
+    /** Applies the active engine to a layout of more than two channels, as set by setChannelLayout.
+        The LFE channel is left dry.
+    */
+    template <typename SampleType>
+    void processMultichannel(SampleType *const *channels, const int numChannels, const int numSamples) noexcept
+    {
+        jassert(numChannels == numLayoutChannels && numLayoutChannels > 2);
+
+        for (int start = 0; start < numSamples; start += blockSize)
+            processMultichannelBlock(channels, jmin(numChannels, numLayoutChannels), start, jmin((int)blockSize, numSamples - start));
+    }
+
+    /** True while the active engine is asleep on silence. */
+    bool isSleeping() const noexcept { return sleeping; }
+
+    /** Returns how long the output of the active engine lasts after the input stops, going by the
+        current parameters: infinite when frozen, the response length for convolution. This is
+        updated by the audio thread and safe to read from any thread.
+    */
+    double getTailLengthSeconds() const noexcept { return tailLengthSeconds.load(std::memory_order_relaxed); }
+
+    ConvolutionReverb &getConvolution() noexcept { return convolution; }
+
+    /** Runs ReverbFX at a lower rate at high sample rates; see ReverbFX::setDownsampling.
+        This clears it, so keep the audio thread out while calling it.
+    */
+    void setDownsampling(const bool shouldDownsample) { reverbFX.setDownsampling(shouldDownsample); }
+
+    //==============================================================================
+    /** Applies the active engine, or the crossfade between two, to a stereo pair. */
+    template <typename SampleType>
+    void processStereo(SampleType *const left, SampleType *const right, const int numSamples) noexcept
+    {
+        SampleType *const channels[] = {left, right};
+        process(channels, 2, numSamples);
+    }
+
+    /** Applies the active engine, or the crossfade between two, to one channel. */
+    template <typename SampleType>
+    void processMono(SampleType *const samples, const int numSamples) noexcept
+    {
+        SampleType *const channels[] = {samples};
+        process(channels, 1, numSamples);
+    }
+
+private:
+    //==============================================================================
+    enum
+    {
+        blockSize = 512
+    };
+
+    static void applyParameters(juce::Reverb &reverb, const Parameters &params) noexcept
+    {
+        juce::Reverb::Parameters p;
+        p.roomSize = params.roomSize;
+        p.damping = params.damping;
+        p.wetLevel = params.wetLevel;
+        p.dryLevel = params.dryLevel;
+        p.width = params.width;
+        p.freezeMode = params.freezeMode;
+        reverb.setParameters(p);
+    }
+
+    template <typename ReverbType>
+    static void applyParameters(ReverbType &reverb, const Parameters &params) noexcept
+    {
+        reverb.setParameters(params);
+    }
+
+    template <typename Function>
+    void forEachEngine(Function &&function)
+    {
+        for (int engine = 0; engine < numEngines; ++engine)
+            withEngine((EngineType)engine, function);
+    }
+
+    template <typename Function>
+    void withEngine(const EngineType engine, Function &&function)
+    {
+        switch (engine)
+        {
+        case EngineType::reverbFX:
+            function(reverbFX);
+            break;
+        case EngineType::fdn8:
+            function(fdn8);
+            break;
+        case EngineType::fdn16:
+            function(fdn16);
+            break;
+        case EngineType::fdn32:
+            function(fdn32);
+            break;
+        case EngineType::convolution:
+            function(convolution);
+            break;
+        case EngineType::juceReverb:
+            function(juceReverb);
+            break;
+        }
+    }
+
+    /** Runs one engine in place and adds the time it took to its tally for this block. */
+    template <typename SampleType>
+    void runEngine(const EngineType engine, SampleType *const *channels, const int numChannels, const int numSamples) noexcept
+    {
+        const auto start = Time::getHighResolutionTicks();
+
+        withEngine(engine, [&](auto &reverb)
+                   {
+            if constexpr (requires { reverb.processMono(channels[0], numSamples); })
+                runInPlace(reverb, channels, numChannels, numSamples);
+            else
+                runConverted(reverb, channels, numChannels, numSamples); });
+
+        blockTicks[(int)engine] += Time::getHighResolutionTicks() - start;
+    }
+
+    template <typename ReverbType, typename SampleType>
+    static void runInPlace(ReverbType &reverb, SampleType *const *channels, const int numChannels, const int numSamples) noexcept
+    {
+        if (numChannels == 2)
+            reverb.processStereo(channels[0], channels[1], numSamples);
+        else
+            reverb.processMono(channels[0], numSamples);
+    }
+
+    /** Runs a float-only engine on double buffers, through conversionBuffer. */
+    template <typename ReverbType, typename SampleType>
+    void runConverted(ReverbType &reverb, SampleType *const *channels, const int numChannels, const int numSamples) noexcept
+    {
+        float *const converted[] = {conversionBuffer[0], conversionBuffer[1]};
+
+        for (int start = 0; start < numSamples; start += blockSize)
+        {
+            const int length = jmin((int)blockSize, numSamples - start);
+
+            for (int ch = 0; ch < numChannels; ++ch)
+                Convert::copy(converted[ch], channels[ch] + start, length);
+
+            runInPlace(reverb, converted, numChannels, length);
+
+            for (int ch = 0; ch < numChannels; ++ch)
+                Convert::copy(channels[ch] + start, converted[ch], length);
+        }
+    }
+
+    template <typename SampleType>
+    void process(SampleType *const *channels, const int numChannels, const int numSamples) noexcept
+    {
+        for (auto &ticks : blockTicks)
+            ticks = 0;
+
+        const float inputPeak = getPeak(channels, numChannels, numSamples);
+        // -100dB is also where decibelsToGain gives up by default, hence the lower floor
+        const float threshold = Decibels::decibelsToGain(silenceThresholdDb, silenceThresholdDb - 20.0f);
+
+        if (sleeping)
+            clearSleepingEngine();
+
+        if (sleeping && inputPeak < threshold && !isCrossfading())
+        {
+            // the engine holds nothing, so all that is left of the output is the dry signal
+            for (int ch = 0; ch < numChannels; ++ch)
+                FloatVectorOperations::multiply(channels[ch], (SampleType)dryGain, numSamples);
+
+            updateCpuLoad(activeEngine, numSamples);
+            return;
+        }
+
+        sleeping = false;
+
+        const auto firstEngine = activeEngine, secondEngine = previousEngine;
+
+        if (!isCrossfading())
+            runEngine(activeEngine, channels, numChannels, numSamples);
+        else
+            for (int start = 0; start < numSamples; start += blockSize)
+                crossfade(channels, numChannels, start, jmin((int)blockSize, numSamples - start));
+
+        updateCpuLoad(firstEngine, numSamples);
+
+        if (secondEngine != firstEngine)
+            updateCpuLoad(secondEngine, numSamples);
+
+        updateSleep(inputPeak < threshold && getPeak(channels, numChannels, numSamples) < threshold, numSamples);
+
+        // the convolution engine picks up new responses between blocks
+        if (activeEngine == EngineType::convolution)
+            updateTailLength();
+
+        if (!isCrossfading() && nextEngine != activeEngine)
+            setEngine(nextEngine);
+    }
+
+    template <typename SampleType>
+    void processMultichannelBlock(SampleType *const *channels, const int numChannels, const int start, const int numSamples) noexcept
+    {
+        float *const send[] = {sendBuffer[0], sendBuffer[1]};
+
+        FloatVectorOperations::clear(send[0], numSamples);
+        FloatVectorOperations::clear(send[1], numSamples);
+
+        for (int c = 0; c < numChannels; ++c)
+        {
+            const SampleType *const input = channels[c] + start;
+
+            switch (layout[c].position)
+            {
+            case ChannelPosition::left:
+                Convert::addWithMultiply(send[0], input, sendGain, numSamples);
+                break;
+            case ChannelPosition::right:
+                Convert::addWithMultiply(send[1], input, sendGain, numSamples);
+                break;
+            case ChannelPosition::centre:
+                Convert::addWithMultiply(send[0], input, sendGain * 0.5f, numSamples);
+                Convert::addWithMultiply(send[1], input, sendGain * 0.5f, numSamples);
+                break;
+            case ChannelPosition::lfe:
+                break;
+            }
+        }
+
+        // the engines run wet only here, so this turns the send into the wet signal
+        process(send, 2, numSamples);
+
+        const bool dryRamping = multichannelDryGain.isSmoothing();
+        const float dry = multichannelDryGain.getTargetValue();
+
+        if (dryRamping)
+            for (int i = 0; i < numSamples; ++i)
+                dryRamp[i] = multichannelDryGain.getNextValue();
+
+        for (int c = 0; c < numChannels; ++c)
+        {
+            SampleType *const output = channels[c] + start;
+
+            if (dryRamping)
+                Convert::multiply(output, dryRamp, numSamples);
+            else
+                FloatVectorOperations::multiply(output, (SampleType)dry, numSamples);
+
+            const auto &channel = layout[c];
+
+            if (channel.position == ChannelPosition::lfe)
+                continue;
+
+            const float *wet = channel.position == ChannelPosition::right ? send[1] : send[0];
+
+            if (channel.position == ChannelPosition::centre)
+            {
+                FloatVectorOperations::add(decorrelationBuffer, send[0], send[1], numSamples);
+                FloatVectorOperations::multiply(decorrelationBuffer, 0.5f, numSamples);
+                wet = decorrelationBuffer;
+            }
+
+            if (channel.decorrelator >= 0)
+            {
+                if (wet != decorrelationBuffer)
+                    FloatVectorOperations::copy(decorrelationBuffer, wet, numSamples);
+
+                decorrelators[channel.decorrelator].process(decorrelationBuffer, numSamples);
+                wet = decorrelationBuffer;
+            }
+
+            Convert::add(output, wet, numSamples);
+        }
+    }
+
+    template <typename SampleType>
+    void crossfade(SampleType *const *channels, const int numChannels, const int start, const int numSamples) noexcept
+    {
+        auto &buffers = getCrossfadeBuffers<SampleType>();
+        SampleType *active[2], *fading[2];
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            active[ch] = channels[ch] + start;
+            fading[ch] = buffers.fading[ch];
+
+            FloatVectorOperations::copy(buffers.input[ch], active[ch], numSamples);
+            FloatVectorOperations::copy(fading[ch], active[ch], numSamples);
+        }
+
+        const int numFading = jmin(numSamples, fadeLength - fadePosition);
+
+        if (numFading > 0)
+            runEngine(previousEngine, fading, numChannels, numSamples);
+
+        runEngine(activeEngine, active, numChannels, numSamples);
+
+        for (int i = 0; i < numFading; ++i)
+        {
+            const float angle = MathConstants<float>::halfPi * (float)(fadePosition + i + 1) / (float)fadeLength;
+            const float fadeIn = std::sin(angle), fadeOut = std::cos(angle);
+
+            // both outputs hold the same dry signal, which unlike the reverbs adds up coherently,
+            // so the dry excess of the equal-power gains is taken back out
+            const float dryCorrection = (fadeIn + fadeOut - 1.0f) * dryGain;
+
+            for (int ch = 0; ch < numChannels; ++ch)
+                active[ch][i] = active[ch][i] * fadeIn + fading[ch][i] * fadeOut - buffers.input[ch][i] * dryCorrection;
+        }
+
+        fadePosition += numFading;
+
+        if (!isCrossfading())
+            finishCrossfade();
+    }
+
+    void finishCrossfade() noexcept
+    {
+        previousEngine = activeEngine;
+        fadePosition = fadeLength = 0;
+    }
+
+    template <typename SampleType>
+    static float getPeak(const SampleType *const *channels, const int numChannels, const int numSamples) noexcept
+    {
+        SampleType peak = 0;
+
+        for (int ch = 0; ch < numChannels; ++ch)
+            peak = jmax(peak, FloatVectorOperations::findMaximum(channels[ch], numSamples),
+                        -FloatVectorOperations::findMinimum(channels[ch], numSamples));
+
+        return (float)peak;
+    }
+
+    /** Counts how long input and output have been silent, and puts the engine to sleep once that
+        is long enough for nothing to be left in it.
+    */
+    void updateSleep(const bool blockIsSilent, const int numSamples) noexcept
+    {
+        if (!blockIsSilent || isCrossfading())
+        {
+            numSilentSamples = 0;
+            return;
+        }
+
+        numSilentSamples += numSamples;
+
+        // a response can hold silent gaps, but none longer than the response itself
+        const double holdSeconds = activeEngine == EngineType::convolution
+                                       ? jmax(sleepHoldSeconds, convolution.getImpulseLengthSeconds())
+                                       : sleepHoldSeconds;
+
+        if (numSilentSamples >= (int64)(holdSeconds * currentSampleRate))
+        {
+            // the block that just ran the engine is not charged for clearing it too
+            sleeping = true;
+            needsClearing = true;
+            numSilentSamples = 0;
+        }
+    }
+
+    /** Clears an engine that has just gone to sleep, once. */
+    void clearSleepingEngine() noexcept
+    {
+        if (!needsClearing)
+            return;
+
+        withEngine(activeEngine, [](auto &reverb)
+                   { reverb.reset(); });
+
+        needsClearing = false;
+    }
+
+    /** Sizes the decorrelators the layout uses for the current rate and frees the others,
+        so a stereo layout holds none.
+    */
+    void prepareDecorrelators()
+    {
+        for (int i = 0; i < maximumChannels; ++i)
+        {
+            if (i < numDecorrelators)
+                decorrelators[i].prepare(i, currentSampleRate);
+            else
+                decorrelators[i].release();
+        }
+    }
+
+    void updateTailLength() noexcept
+    {
+        const double seconds = activeEngine == EngineType::convolution
+                                   ? convolution.getImpulseLengthSeconds()
+                                   : ReverbFX::getTailLengthSeconds(parameters, -silenceThresholdDb);
+
+        tailLengthSeconds.store(seconds, std::memory_order_relaxed);
+    }
+
+    void updateCpuLoad(const EngineType engine, const int numSamples) noexcept
+    {
+        if (numSamples <= 0)
+            return;
+
+        const double blockSeconds = numSamples / currentSampleRate;
+        const auto load = (float)(Time::highResolutionTicksToSeconds(blockTicks[(int)engine]) / blockSeconds);
+
+        auto &smoothed = cpuLoads[(int)engine];
+        smoothed.store(smoothed.load(std::memory_order_relaxed) * 0.9f + load * 0.1f, std::memory_order_relaxed);
+    }
+
+    /** FloatVectorOperations when both sides have the same type, a converting loop otherwise. */
+    struct Convert
+    {
+        template <typename Destination, typename Source>
+        static void copy(Destination *const destination, const Source *const source, const int numSamples) noexcept
+        {
+            if constexpr (std::is_same_v<Destination, Source>)
+                FloatVectorOperations::copy(destination, source, numSamples);
+            else
+                for (int i = 0; i < numSamples; ++i)
+                    destination[i] = (Destination)source[i];
+        }
+
+        template <typename Destination, typename Source>
+        static void add(Destination *const destination, const Source *const source, const int numSamples) noexcept
+        {
+            if constexpr (std::is_same_v<Destination, Source>)
+                FloatVectorOperations::add(destination, source, numSamples);
+            else
+                for (int i = 0; i < numSamples; ++i)
+                    destination[i] += (Destination)source[i];
+        }
+
+        template <typename Destination, typename Source>
+        static void multiply(Destination *const destination, const Source *const source, const int numSamples) noexcept
+        {
+            if constexpr (std::is_same_v<Destination, Source>)
+                FloatVectorOperations::multiply(destination, source, numSamples);
+            else
+                for (int i = 0; i < numSamples; ++i)
+                    destination[i] *= (Destination)source[i];
+        }
+
+        template <typename Destination, typename Source>
+        static void addWithMultiply(Destination *const destination, const Source *const source, const float gain, const int numSamples) noexcept
+        {
+            if constexpr (std::is_same_v<Destination, Source>)
+                FloatVectorOperations::addWithMultiply(destination, source, (Destination)gain, numSamples);
+            else
+                for (int i = 0; i < numSamples; ++i)
+                    destination[i] += (Destination)(source[i] * gain);
+        }
+    };
+
+    /** What a crossfade keeps aside per block: the input both engines start from, and the output of the one fading out. */
+    template <typename SampleType>
+    struct CrossfadeBuffers
+    {
+        SampleType input[2][blockSize] = {};
+        SampleType fading[2][blockSize] = {};
+    };
+
+    template <typename SampleType>
+    CrossfadeBuffers<SampleType> &getCrossfadeBuffers() noexcept
+    {
+        if constexpr (std::is_same_v<SampleType, double>)
+            return doubleCrossfade;
+        else
+            return floatCrossfade;
+    }
+
+    //==============================================================================
+    ReverbFX reverbFX;
+    FDNReverb<8> fdn8;
+    FDNReverb<16> fdn16;
+    FDNReverb<32> fdn32;
+    ConvolutionReverb convolution;
+    juce::Reverb juceReverb;
+
+    double currentSampleRate = 44100.0;
+    float dryGain = 0;
+    Parameters parameters;
+
+    struct LayoutChannel
+    {
+        ChannelPosition position = ChannelPosition::centre;
+        int decorrelator = -1;
+    };
+
+    LayoutChannel layout[maximumChannels];
+    int numLayoutChannels = 0;
+    float sendGain = 1.0f;
+    SmoothedValue<float> multichannelDryGain;
+    Decorrelator decorrelators[maximumChannels];
+    int numDecorrelators = 0;
+
+    bool sleeping = false, needsClearing = false;
+    int64 numSilentSamples = 0;
+    std::atomic<double> tailLengthSeconds{0};
+
+    EngineType activeEngine = EngineType::reverbFX, previousEngine = EngineType::reverbFX, nextEngine = EngineType::reverbFX;
+    int fadeLength = 0, fadePosition = 0;
+
+    int64 blockTicks[numEngines] = {};
+    std::atomic<float> cpuLoads[numEngines] = {};
+
+    CrossfadeBuffers<float> floatCrossfade;
+    CrossfadeBuffers<double> doubleCrossfade;
+    float conversionBuffer[2][blockSize] = {};
+    float sendBuffer[2][blockSize] = {};
+    float dryRamp[blockSize] = {};
+    float decorrelationBuffer[blockSize] = {};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ReverbEngines)
+};
@@ -21,8 +21,109 @@
 
 #pragma once
 
-// #include <immintrin.h> // @TODO optimize proceesing with SIMD
 #include <JuceHeader.h>
+#include "HalfBandFilter.h"
+#include "EarlyReflections.h"
+
+//==============================================================================
+// enum E_Color
+// {
+//     Bright,
+//     Dark,
+//     70s,
+//     80s
+// };
+
+/** Holds the parameters being used by a Reverb object. */
+struct ReverbParameters
+{
+    float roomSize = 0.5f;   /**< Room size, 0 to 1.0, where 1.0 is big, 0 is small. */
+    float damping = 0.5f;    /**< Damping, 0 to 1.0, where 0 is not damped, 1.0 is fully damped. */
+    float wetLevel = 0.33f;  /**< Wet level, 0 to 1.0 */
+    float dryLevel = 0.4f;   /**< Dry level, 0 to 1.0 */
+    float width = 1.0f;      /**< Reverb width, 0 to 1.0, where 1.0 is very wide. */
+    float freezeMode = 0.0f; /**< Freeze mode - values < 0.5 are "normal" mode, values > 0.5
+                                  put the reverb into a continuous feedback loop. */
+
+    // Diffusion parameters
+    float diffusionFeedback = 0.5f; /**< Diffusion feedback level, 0 to 1.0 */
+
+    // Modulation parameters
+    float modulationDepth = 0.0f; /**< Depth of the delay modulation, 0 (off) to 1.0 */
+    float modulationRate = 0.5f;  /**< Rate of the delay modulation in Hz */
+
+    // Early reflection parameters
+    float earlyLevel = 0.0f; /**< Level of the early reflections, 0 (off) to 1.0 */
+
+    // E_Color color{Bright};
+};
+
+//==============================================================================
+/** What every network topology shares: how its channels are spread and how tunings scale. */
+struct ReverbTunings
+{
+    static constexpr int stereoSpread = 43;                /**< Added to every length of each further channel. */
+    static constexpr float diffusionFeedbackLevel = 0.55f; /**< Feedback inside each diffusion comb. */
+
+    /** Converts a tuning to samples at the given sample rate. */
+    static int scale(const int tuning, const double sampleRate) noexcept
+    {
+        return ((int)sampleRate * tuning) / 44100;
+    }
+};
+
+/** The network ReverbFX has always run: delay lengths in samples at 44.1kHz, based on FreeVerb. */
+struct StandardTopology : ReverbTunings
+{
+    static constexpr short combs[] = {1116, 1188, 1277, 1356, 1422, 1491, 1557, 1617};
+    static constexpr short allPasses[] = {556, 441, 341, 225};
+    static constexpr short diffusion[] = {
+        116,
+        208,
+        301,
+        353,
+        420,
+        585,
+        666,
+        750,
+        999,
+        1103,
+        1200,
+        1313,
+        1535,
+        1609,
+        1685,
+        1700,
+    }; // Adjust these values based on experimentation
+
+    /** Output gains of the comb and diffusion sums, to keep topologies at the same level. */
+    static constexpr float combGain = 1.0f, diffusionGain = 1.0f;
+};
+
+/** Half the combs, all-passes and diffusion combs of StandardTopology, for when CPU is tight. */
+struct LightTopology : ReverbTunings
+{
+    static constexpr short combs[] = {1116, 1277, 1422, 1617};
+    static constexpr short allPasses[] = {556, 341};
+    static constexpr short diffusion[] = {116, 301, 420, 666, 999, 1200, 1535, 1700};
+
+    // half as many uncorrelated lines add up to 3dB less, and each all-pass left out would have
+    // added about 3.7dB to the comb output, so the combs need about 10.4dB back
+    static constexpr float combGain = 3.32f, diffusionGain = 1.4142136f;
+};
+
+/** Twice the combs of StandardTopology, interleaved with its lengths, for a denser tail. */
+struct DenseTopology : ReverbTunings
+{
+    static constexpr short combs[] = {1116, 1151, 1188, 1233, 1277, 1318, 1356, 1389,
+                                      1422, 1457, 1491, 1523, 1557, 1589, 1617, 1653};
+    static constexpr short allPasses[] = {556, 441, 379, 341, 277, 225};
+    static constexpr short diffusion[] = {116, 208, 301, 353, 420, 585, 666, 750,
+                                          999, 1103, 1200, 1313, 1535, 1609, 1685, 1700};
+
+    // twice the combs and two more all-passes come out about 10.4dB louder
+    static constexpr float combGain = 0.301f, diffusionGain = 1.0f;
+};
 
 //==============================================================================
 /**
@@ -30,70 +131,154 @@
 
     This is a a modified version of simple JUCE stereo reverb, based on the technique and tunings used in FreeVerb.
 
+    The network has NumChannels outputs, each channel's delay lines stereoSpread samples longer
+    than the previous one's, and the number of combs, all-passes and diffusion combs comes from
+    the Topology, so every loop over them has a length known at compile time. ReverbFX is the
+    stereo network of StandardTopology; MonoReverbFX runs the same network on one channel.
+
+    The process methods switch the FPU to flush denormals to zero for their duration, so the
+    decaying feedback paths never slow down, whatever the caller has set up.
+
+    Besides processing in place, the reverb can read one pair of buffers and write another, and
+    make the wet signal only, as on a send/return bus; a send can also be mono into a stereo network.
+
+    With a modulation depth above zero, slow LFOs move the comb and diffusion delays by up to
+    maximumModulationSeconds, which breaks up the metallic ringing of fixed delays on long tails.
+    The LFOs run at control rate and the delays are read with linear interpolation. At zero depth
+    the network runs exactly as without modulation.
+
+    Early reflections, at a level above zero, are added to the wet signal from a few taps on
+    the input, laid out for the room size and width; see EarlyReflections. They run at the host
+    rate, ahead of any downsampling. With them in front, the diffusion share can go to zero,
+    and the diffusion filters then stop running altogether.
+
+    The process methods take float or double buffers. StorageType sets the precision of the delay
+    lines and the network on its own: with double I/O and float storage, only the input and the
+    output mix run in double, and the delay memory keeps half the size and bandwidth.
 */
-class ReverbFX
+template <int NumChannels, typename Topology = StandardTopology, typename StorageType = float>
+class BasicReverbFX
 {
 public:
     //==============================================================================
-    ReverbFX()
+    using Parameters = ReverbParameters;
+
+    BasicReverbFX()
     {
+        allocateArena(layoutDelayLines(maximumSampleRate, nullptr));
         setParameters(Parameters());
         setSampleRate(44100.0);
     }
 
-    //==============================================================================
-
-    // enum E_Color
-    // {
-    //     Bright,
-    //     Dark,
-    //     70s,
-    //     80s
-    // };
-
-    /** Holds the parameters being used by a Reverb object. */
-    struct Parameters
-    {
-        float roomSize = 0.5f;   /**< Room size, 0 to 1.0, where 1.0 is big, 0 is small. */
-        float damping = 0.5f;    /**< Damping, 0 to 1.0, where 0 is not damped, 1.0 is fully damped. */
-        float wetLevel = 0.33f;  /**< Wet level, 0 to 1.0 */
-        float dryLevel = 0.4f;   /**< Dry level, 0 to 1.0 */
-        float width = 1.0f;      /**< Reverb width, 0 to 1.0, where 1.0 is very wide. */
-        float freezeMode = 0.0f; /**< Freeze mode - values < 0.5 are "normal" mode, values > 0.5
-                                      put the reverb into a continuous feedback loop. */
-
-        // Diffusion parameters
-        float diffusionFeedback = 0.5f; /**< Diffusion feedback level, 0 to 1.0 */
-
-        // E_Color color{Bright};
-    };
-
     //==============================================================================
     /** Returns the reverb's current parameters. */
     const Parameters &getParameters() const noexcept { return parameters; }
 
     /** Applies a new set of parameters to the reverb.
         Note that this doesn't attempt to lock the reverb, so if you call this in parallel with
-        the process method, you may get artifacts.
+        the process method, you may get artifacts. Other threads should only flag a change and
+        let the audio thread call this, as ReverbProjectAudioProcessor does.
     */
     void setParameters(const Parameters &newParams)
+    {
+        const auto coefficients = getCoefficients(newParams);
+
+        dryGain.setTargetValue(coefficients.dryGain);
+        wetGain1.setTargetValue(coefficients.wetGain1);
+        wetGain2.setTargetValue(coefficients.wetGain2);
+        diffusionFeedback.setTargetValue(coefficients.combWeight);
+        damping.setTargetValue(coefficients.damping);
+        feedback.setTargetValue(coefficients.feedback);
+        earlyGain.setTargetValue(coefficients.earlyGain);
+        earlyReflections.select(newParams.roomSize, newParams.width);
+        modulation.setTarget(newParams.modulationDepth, newParams.modulationRate);
+
+        gain = coefficients.inputGain;
+        parameters = newParams;
+    }
+
+    //==============================================================================
+    /** The values the network actually runs on, derived from a set of Parameters. */
+    struct Coefficients
+    {
+        float inputGain = 0;  /**< Gain into the network, 0 when frozen. */
+        float damping = 0;    /**< Damping of the comb feedback. */
+        float feedback = 0;   /**< Comb feedback, from the room size. */
+        float dryGain = 0;    /**< Gain of the dry signal. */
+        float wetGain1 = 0;   /**< Wet gain of a channel's own reverb. */
+        float wetGain2 = 0;   /**< Wet gain of the other channel's reverb. */
+        float combWeight = 0; /**< Share of the comb network in the wet signal, the rest is diffusion. */
+        float earlyGain = 0;  /**< Gain of the early reflections. */
+    };
+
+    static Coefficients getCoefficients(const Parameters &params) noexcept
     {
         const float wetScaleFactor = 3.0f;
         const float dryScaleFactor = 2.0f;
+        const float roomScaleFactor = 0.28f;
+        const float roomOffset = 0.7f;
+        const float dampScaleFactor = 0.4f;
+        const float earlyScaleFactor = 25.0f;
+
+        Coefficients coefficients;
+        const float wet = params.wetLevel * wetScaleFactor;
+        coefficients.dryGain = params.dryLevel * dryScaleFactor;
+        coefficients.wetGain1 = 0.5f * wet * (1.0f + params.width);
+        coefficients.wetGain2 = 0.5f * wet * (1.0f - params.width);
+        coefficients.combWeight = params.diffusionFeedback;
+        coefficients.earlyGain = params.earlyLevel * wet * earlyScaleFactor;
+
+        if (isFrozen(params.freezeMode))
+        {
+            coefficients.inputGain = 0.0f;
+            coefficients.damping = 0.0f;
+            coefficients.feedback = 1.0f;
+        }
+        else
+        {
+            coefficients.inputGain = 0.015f;
+            coefficients.damping = params.damping * dampScaleFactor;
+            coefficients.feedback = params.roomSize * roomScaleFactor + roomOffset;
+        }
+
+        return coefficients;
+    }
+
+    /** Returns how long the tail takes to fall by decayDb once the input stops, going by the
+        longest comb, lengthened by the modulation excursion, and its level drops by the feedback on
+        every trip round. Damping only speeds up the decay of the highs, so this holds for the lows.
+        The tail of a frozen reverb is infinite.
+    */
+    static double getTailLengthSeconds(const Parameters &params, const double decayDb) noexcept
+    {
+        if (isFrozen(params.freezeMode))
+            return std::numeric_limits<double>::infinity();
 
-        const float wet = newParams.wetLevel * wetScaleFactor;
-        dryGain.setTargetValue(newParams.dryLevel * dryScaleFactor);
-        wetGain1.setTargetValue(0.5f * wet * (1.0f + newParams.width));
-        wetGain2.setTargetValue(0.5f * wet * (1.0f - newParams.width));
+        int longestComb = 0;
 
-        diffusionFeedback.setTargetValue(newParams.diffusionFeedback);
+        for (int i = 0; i < numCombs; ++i)
+            longestComb = jmax(longestComb, (int)Tunings::combs[i]);
 
-        gain = isFrozen(newParams.freezeMode) ? 0.0f : 0.015f;
-        parameters = newParams;
-        updateDamping();
+        const double excursionSeconds = jlimit(0.0f, 1.0f, params.modulationDepth) * maximumModulationSeconds;
+        const double loopSeconds = (longestComb + (numChannels - 1) * Tunings::stereoSpread) / 44100.0 + excursionSeconds;
+        const double lossPerLoopDb = -20.0 * std::log10((double)getCoefficients(params).feedback);
+
+        return loopSeconds * decayDb / lossPerLoopDb;
     }
 
     //==============================================================================
+    /** Delay lengths of this reverb's network; see StandardTopology. */
+    using Tunings = Topology;
+
+    //==============================================================================
+    /** The highest sample rate the delay memory is allocated for when the reverb is created.
+        Higher rates still work, but setSampleRate will then have to reallocate.
+    */
+    static constexpr double maximumSampleRate = 192000.0;
+
+    /** How far either way the modulation moves the comb and diffusion delays at full depth. */
+    static constexpr double maximumModulationSeconds = 0.0005;
+
     /** Sets the sample rate that will be used for the reverb.
         You must call this before the process methods, in order to tell it the correct sample rate.
     */
@@ -101,158 +286,144 @@ public:
     {
         jassert(sampleRate > 0);
 
-        static const short combTunings[] = {1116, 1188, 1277, 1356, 1422, 1491, 1557, 1617}; // (at 44100Hz)
-        static const short allPassTunings[] = {556, 441, 341, 225};
-        const int stereoSpread = 43;
-        const int intSampleRate = (int)sampleRate;
+        downsamplingFactor = downsampling ? getDownsamplingFactor(sampleRate) : 1;
+        const double networkSampleRate = sampleRate / downsamplingFactor;
 
-        for (int i = 0; i < numCombs; ++i)
-        {
-            comb[0][i].setSize((intSampleRate * combTunings[i]) / 44100);
-            comb[1][i].setSize((intSampleRate * (combTunings[i] + stereoSpread)) / 44100);
-        }
+        const auto numSamplesNeeded = layoutDelayLines(networkSampleRate, nullptr);
 
-        for (int i = 0; i < numAllPasses; ++i)
-        {
-            allPass[0][i].setSize((intSampleRate * allPassTunings[i]) / 44100);
-            allPass[1][i].setSize((intSampleRate * (allPassTunings[i] + stereoSpread)) / 44100);
-        }
-
-        const short diffusionTunings[] = {
-            116,
-            208,
-            301,
-            353,
-            420,
-            585,
-            666,
-            750,
-            999,
-            1103,
-            1200,
-            1313,
-            1535,
-            1609,
-            1685,
-            1700,
-        }; // Adjust these values based on experimentation
+        if (numSamplesNeeded > arenaSize)
+            allocateArena(numSamplesNeeded);
 
-        for (int i = 0; i < numDiffusionCombs; ++i)
-        {
-            diffusion[0][i].setSize((intSampleRate * diffusionTunings[i]) / 44100);
-            diffusion[1][i].setSize((intSampleRate * (diffusionTunings[i] + stereoSpread)) / 44100);
-        }
+        layoutDelayLines(networkSampleRate, arena);
+        currentSampleRate = sampleRate;
 
+        // the network coefficients are read once per network sample, the gains once per output sample
         const double smoothTime = 0.01;
-        damping.reset(sampleRate, smoothTime);
-        feedback.reset(sampleRate, smoothTime);
+        damping.reset(networkSampleRate, smoothTime);
+        feedback.reset(networkSampleRate, smoothTime);
+        modulation.prepare(networkSampleRate);
         dryGain.reset(sampleRate, smoothTime);
         wetGain1.reset(sampleRate, smoothTime);
         wetGain2.reset(sampleRate, smoothTime);
+        earlyGain.reset(sampleRate, smoothTime);
+        earlyReflections.prepare(sampleRate);
+
+        resetResampling();
     }
 
     /** Clears the reverb's buffers. */
     void reset()
     {
-        for (int j = 0; j < numChannels; ++j)
-        {
-            for (int i = 0; i < numCombs; ++i)
-                comb[j][i].clear();
+        combs.clear();
 
-            for (int i = 0; i < numAllPasses; ++i)
-                allPass[j][i].clear();
+        for (auto &filter : allPass)
+            filter.clear();
 
-            for (int i = 0; i < numDiffusionCombs; ++i)
-                diffusion[j][i].clear();
-        }
+        for (auto &filter : diffusion)
+            filter.clear();
+
+        modulation.reset();
+        restoreDiffusionDelays();
+        earlyReflections.reset();
+        resetResampling();
     }
 
     //==============================================================================
-    /** Applies the reverb to two stereo channels of audio data. */
-    void processStereo(float *const left, float *const right, const int numSamples) noexcept
-    {
-        JUCE_BEGIN_IGNORE_WARNINGS_MSVC(6011)
-        jassert(left != nullptr && right != nullptr);
-
-        for (int i = 0; i < numSamples; ++i)
-        {
-            // NOLINTNEXTLINE(clang-analyzer-core.NullDereference)
-            const float input = (left[i] + right[i]) * gain;
-            float outL = 0, outR = 0;
-
-            float diffOutL = 0, diffOutR = 0;
-            const float diffFeedbck = 0.55f;
+    /** The lowest rate the network is taken down to when downsampling. */
+    static constexpr double minimumNetworkSampleRate = 44100.0;
 
-            const float damp = damping.getNextValue();
-            const float feedbck = feedback.getNextValue();
+    /** Chooses whether the network runs at a lower rate than the host at high sample rates.
 
-            // Comb Filters
-            for (int j = 0; j < numCombs; ++j)
-            {
-                outL += comb[0][j].process(input, damp, feedbck);
-                outR += comb[1][j].process(input, damp, feedbck);
-            }
+        When enabled, the reverb input is decimated with half-band filters by two or four, to
+        the lowest rate that is still at least minimumNetworkSampleRate, and the wet signal is
+        interpolated back up; the dry signal is untouched. The tail then carries nothing above
+        about 20kHz, but the network costs and touches half or a quarter as much at 96k or 192k.
+        At 48k and below this changes nothing. This clears the buffers.
+    */
+    void setDownsampling(const bool shouldDownsample)
+    {
+        downsampling = shouldDownsample;
+        setSampleRate(currentSampleRate);
+    }
 
-            // All-Pass Filters
-            for (int j = 0; j < numAllPasses; ++j)
-            {
-                outL = allPass[0][j].process(outL);
-                outR = allPass[1][j].process(outR);
-            }
+    bool isDownsampling() const noexcept { return downsampling; }
 
-            // Diffusion Filters
-            for (int j = 0; j < numDiffusionCombs; ++j)
-            {
-                diffOutL += diffusion[0][j].process(input, diffFeedbck);
-                diffOutR += diffusion[1][j].process(input, diffFeedbck);
-            }
+    /** Returns the rate the comb, all-pass and diffusion network currently runs at. */
+    double getNetworkSampleRate() const noexcept { return currentSampleRate / downsamplingFactor; }
 
-            const float dry = dryGain.getNextValue();
-            const float wet1 = wetGain1.getNextValue();
-            const float wet2 = wetGain2.getNextValue();
+    /** Chooses how the channels of each all-pass and diffusion line are stored.
+        When interleaved, the samples all channels write at the same time share a cache line,
+        which helps when many instances compete for the cache; otherwise (the default) each
+        channel gets its own contiguous plane, which vectorises better. This clears the buffers.
+    */
+    void setInterleavedChannels(const bool shouldInterleave)
+    {
+        interleaveChannels = shouldInterleave;
+        layoutDelayLines(getNetworkSampleRate(), arena);
+    }
 
-            const float WeightRatio = diffusionFeedback.getNextValue();
+    /** Chooses whether the outputs hold only the reverb, whatever the dry level, as a return bus
+        wants them. The dry signal is then never multiplied in, rather than multiplied by zero.
+    */
+    void setWetOnly(const bool shouldBeWetOnly) noexcept { wetOnly = shouldBeWetOnly; }
 
-            const float combWeight = WeightRatio;          // Adjust as needed
-            const float diffusionWeight = 1 - WeightRatio; // Adjust as needed
+    bool isWetOnly() const noexcept { return wetOnly; }
 
-            // Weighted Summation:
-            left[i] = (outL * combWeight + diffOutL * diffusionWeight) * wet1 + (outR * combWeight + diffOutR * diffusionWeight) * wet2 + left[i] * dry;
-            right[i] = (outR * combWeight + diffOutR * diffusionWeight) * wet1 + (outL * combWeight + diffOutL * diffusionWeight) * wet2 + right[i] * dry;
+    /** Returns the number of bytes of delay memory owned by this reverb. */
+    size_t getMemoryFootprint() const noexcept { return arenaSize * sizeof(StorageType); }
 
-            // // No diffusion
-            // left[i] = outL * wet1 + outR * wet2 + left[i] * dry;
-            // right[i] = outR * wet1 + outL * wet2 + right[i] * dry;
-        }
-        JUCE_END_IGNORE_WARNINGS_MSVC
+    //==============================================================================
+    /** Applies the reverb to two stereo channels of audio data. */
+    template <typename SampleType>
+    void processStereo(SampleType *const left, SampleType *const right, const int numSamples) noexcept
+        requires(NumChannels == 2)
+    {
+        process(left, right, left, right, numSamples);
     }
 
-    /** Applies the reverb to a single mono channel of audio data. */
-    // For the time being mono does not use diffusion network for processing
-    void processMono(float *const samples, const int numSamples) noexcept
+    /** Reads a stereo pair and writes the reverb of it to another pair.
+
+        With a null inputRight the input is a mono send, which feeds the network as processMono
+        does and is the dry signal of both outputs; either output may then be the send itself.
+        Otherwise each output may be the same buffer as the input of its own side, but not of the other.
+    */
+    template <typename SampleType>
+    void process(const SampleType *const inputLeft, const std::type_identity_t<SampleType> *const inputRight,
+                 SampleType *const outputLeft, SampleType *const outputRight, const int numSamples) noexcept
+        requires(NumChannels == 2)
     {
         JUCE_BEGIN_IGNORE_WARNINGS_MSVC(6011)
-        jassert(samples != nullptr);
+        jassert(inputLeft != nullptr && outputLeft != nullptr && outputRight != nullptr);
+        jassert(inputRight == nullptr || (outputLeft != inputRight && outputRight != inputLeft));
+        const ScopedNoDenormals noDenormals;
 
-        for (int i = 0; i < numSamples; ++i)
-        {
-            const float input = samples[i] * gain;
-            float output = 0;
+        for (int start = 0; start < numSamples; start += blockSize)
+            processStereoBlock(inputLeft + start, inputRight != nullptr ? inputRight + start : nullptr,
+                               outputLeft + start, outputRight + start, jmin((int)blockSize, numSamples - start));
 
-            const float damp = damping.getNextValue();
-            const float feedbck = feedback.getNextValue();
+        JUCE_END_IGNORE_WARNINGS_MSVC
+    }
 
-            for (int j = 0; j < numCombs; ++j) // accumulate the comb filters in parallel
-                output += comb[0][j].process(input, damp, feedbck);
+    /** Applies the reverb to a single mono channel of audio data.
+        The whole network runs and its channels are summed at equal power, so width has no effect.
+    */
+    template <typename SampleType>
+    void processMono(SampleType *const samples, const int numSamples) noexcept
+    {
+        processMono(samples, samples, numSamples);
+    }
 
-            for (int j = 0; j < numAllPasses; ++j) // run the allpass filters in series
-                output = allPass[0][j].process(output);
+    /** Reads one channel and writes the reverb of it to another, which may be the same buffer. */
+    template <typename SampleType>
+    void processMono(const SampleType *const input, SampleType *const output, const int numSamples) noexcept
+    {
+        JUCE_BEGIN_IGNORE_WARNINGS_MSVC(6011)
+        jassert(input != nullptr && output != nullptr);
+        const ScopedNoDenormals noDenormals;
 
-            const float dry = dryGain.getNextValue();
-            const float wet1 = wetGain1.getNextValue();
+        for (int start = 0; start < numSamples; start += blockSize)
+            processMonoBlock(input + start, output + start, jmin((int)blockSize, numSamples - start));
 
-            samples[i] = output * wet1 + samples[i] * dry;
-        }
         JUCE_END_IGNORE_WARNINGS_MSVC
     }
 
@@ -260,171 +431,1362 @@ private:
     //==============================================================================
     static bool isFrozen(const float freezeMode) noexcept { return freezeMode >= 0.5f; }
 
-    void updateDamping() noexcept
+    //==============================================================================
+    // The block methods run the network stage by stage over at most blockSize samples,
+    // so every stage is a tight loop over contiguous memory.
+    // A null inRight is a mono send, whose one channel is also the dry signal of both sides.
+    template <typename SampleType>
+    void processStereoBlock(const SampleType *const inLeft, const SampleType *const inRight,
+                            SampleType *const left, SampleType *const right, const int numSamples) noexcept
     {
-        const float roomScaleFactor = 0.28f;
-        const float roomOffset = 0.7f;
-        const float dampScaleFactor = 0.4f;
+        static_assert(std::is_floating_point_v<SampleType>, "the reverb processes float or double samples");
 
-        if (isFrozen(parameters.freezeMode))
-            setDamping(0.0f, 1.0f);
+        if (inRight == nullptr)
+        {
+            for (int i = 0; i < numSamples; ++i)
+                inputBuffer[i] = (StorageType)(inLeft[i] * gain);
+        }
         else
-            setDamping(parameters.damping * dampScaleFactor,
-                       parameters.roomSize * roomScaleFactor + roomOffset);
-    }
+        {
+            for (int i = 0; i < numSamples; ++i)
+            {
+                // NOLINTNEXTLINE(clang-analyzer-core.NullDereference)
+                inputBuffer[i] = (StorageType)((inLeft[i] + inRight[i]) * gain);
+            }
+        }
 
-    void setDamping(const float dampingToUse, const float roomSizeToUse) noexcept
-    {
-        damping.setTargetValue(dampingToUse);
-        feedback.setTargetValue(roomSizeToUse);
+        const SampleType *const dryLeft = inLeft;
+        const SampleType *const dryRight = inRight != nullptr ? inRight : inLeft;
+        const bool withEarlyReflections = processEarlyReflections(numSamples);
+
+        if (downsamplingFactor > 1)
+        {
+            processStereoDownsampled(dryLeft, dryRight, left, right, numSamples);
+
+            if (withEarlyReflections)
+                addEarlyReflections(left, right, numSamples);
+
+            return;
+        }
+
+        processNetwork(numSamples);
+
+        // when nothing is ramping, the mix runs on constant gains
+        if (dryGain.isSmoothing() || wetGain1.isSmoothing() || wetGain2.isSmoothing() || diffusionFeedback.isSmoothing())
+        {
+            dryGain.fill(dryBuffer, numSamples);
+            wetGain1.fill(wetBuffer1, numSamples);
+            wetGain2.fill(wetBuffer2, numSamples);
+            diffusionFeedback.fill(weightBuffer, numSamples);
+
+            withDry(FromBuffer{dryBuffer}, [&](auto dryAt)
+                    { mixStereo(dryLeft, dryRight, left, right, numSamples, dryAt, FromBuffer{wetBuffer1},
+                                FromBuffer{wetBuffer2}, FromBuffer{weightBuffer}); });
+        }
+        else
+        {
+            withDry(Constant{dryGain.getTargetValue()}, [&](auto dryAt)
+                    { mixStereo(dryLeft, dryRight, left, right, numSamples, dryAt, Constant{wetGain1.getTargetValue()},
+                                Constant{wetGain2.getTargetValue()}, Constant{diffusionFeedback.getTargetValue()}); });
+        }
+
+        if (withEarlyReflections)
+            addEarlyReflections(left, right, numSamples);
     }
 
-private:
-    //==============================================================================
-    class DiffusionFilter
+    void processNetwork(const int numSamples) noexcept
     {
-    public:
-        DiffusionFilter() noexcept {}
+        const float diffFeedbck = Tunings::diffusionFeedbackLevel;
 
-        void setSize(const int size)
-        {
-            if (size != bufferSize)
-            {
-                bufferIndex = 0;
-                buffer.malloc(size);
-                bufferSize = size;
-            }
+        // the comb and diffusion stages read their delays for this block from the same plan
+        const bool modulated = modulation.isActive();
 
-            clear();
-        }
+        if (modulated)
+            modulation.plan(numSamples);
+        else if (diffusionModulated)
+            restoreDiffusionDelays();
 
-        void clear() noexcept
+        // Comb Filters
+        processCombs(numSamples, modulated);
+
+        // All-Pass Filters
+        for (auto &filter : allPass)
+            filter.process(combBuffer, numSamples);
+
+        // Diffusion Filters
+        for (auto &channel : diffusionBuffer)
+            FloatVectorOperations::clear(channel, numSamples);
+
+        // with the whole wet share on the combs the diffusion output is weighed by zero, so the
+        // filters rest, and start again from silence rather than from what they last held
+        if (!diffusionFeedback.isSmoothing() && diffusionFeedback.getTargetValue() >= 1.0f)
         {
-            buffer.clear((size_t)bufferSize);
+            diffusionResting = true;
+            return;
         }
 
-        float process(const float input, const float feedbackLevel) noexcept
+        if (diffusionResting)
         {
-            const float output = buffer[bufferIndex];
-            float temp = input + (output * feedbackLevel);
+            for (auto &filter : diffusion)
+                filter.clear();
 
-            // JUCE_UNDENORMALISE(temp);
-            buffer[bufferIndex] = temp;
-            bufferIndex = (bufferIndex + 1) % bufferSize;
-            return output;
+            diffusionResting = false;
         }
 
-    private:
-        HeapBlock<float> buffer;
-        int bufferSize = 0, bufferIndex = 0;
+        for (int i = 0; i < numDiffusionCombs; ++i)
+        {
+            if (modulated)
+                diffusion[i].process(inputBuffer, diffFeedbck, diffusionBuffer, numSamples,
+                                     modulation, DelayModulation::getDiffusionLine(i));
+            else
+                diffusion[i].process(inputBuffer, diffFeedbck, diffusionBuffer, numSamples);
+        }
 
-        JUCE_DECLARE_NON_COPYABLE(DiffusionFilter)
-    };
+        diffusionModulated = modulated;
+    }
 
-    //==============================================================================
-    class CombFilter
+    /** Puts every diffusion line back to its own delay. The unmodulated path reads whatever
+        delays the lines were left with, so this has to follow the last modulated block.
+    */
+    void restoreDiffusionDelays() noexcept
     {
-    public:
-        CombFilter() noexcept {}
+        for (auto &filter : diffusion)
+            filter.setModulation(nullptr);
 
-        void setSize(const int size)
+        diffusionModulated = false;
+    }
+
+    template <typename SampleType, typename Dry, typename Wet1, typename Wet2, typename Weight>
+    void mixStereo(const SampleType *const inLeft, const SampleType *const inRight,
+                   SampleType *const left, SampleType *const right, const int numSamples,
+                   Dry dryAt, Wet1 wet1At, Wet2 wet2At, Weight weightAt) noexcept
+    {
+        for (int i = 0; i < numSamples; ++i)
         {
-            if (size != bufferSize)
+            const StorageType outL = combBuffer[0][i], outR = combBuffer[1][i];
+            const StorageType diffOutL = diffusionBuffer[0][i], diffOutR = diffusionBuffer[1][i];
+
+            const float wet1 = wet1At(i);
+            const float wet2 = wet2At(i);
+
+            const float WeightRatio = weightAt(i);
+
+            const float combWeight = WeightRatio * Tunings::combGain;                // Adjust as needed
+            const float diffusionWeight = (1 - WeightRatio) * Tunings::diffusionGain; // Adjust as needed
+
+            // Weighted Summation:
+            const StorageType wetL = (outL * combWeight + diffOutL * diffusionWeight) * wet1 + (outR * combWeight + diffOutR * diffusionWeight) * wet2;
+            const StorageType wetR = (outR * combWeight + diffOutR * diffusionWeight) * wet1 + (outL * combWeight + diffOutL * diffusionWeight) * wet2;
+
+            if constexpr (std::is_same_v<Dry, NoDry>)
+            {
+                left[i] = (SampleType)wetL;
+                right[i] = (SampleType)wetR;
+            }
+            else
             {
-                bufferIndex = 0;
-                buffer.malloc(size);
-                bufferSize = size;
+                // both dry samples are read before either output is written, as a mono send
+                // processed in place is the dry signal of both sides
+                const float dry = dryAt(i);
+                const SampleType dryL = inLeft[i], dryR = inRight[i];
+                left[i] = (SampleType)(wetL + dryL * dry);
+                right[i] = (SampleType)(wetR + dryR * dry);
             }
 
-            clear();
+            // // No diffusion
+            // left[i] = outL * wet1 + outR * wet2 + left[i] * dry;
+            // right[i] = outR * wet1 + outL * wet2 + right[i] * dry;
         }
+    }
 
-        void clear() noexcept
-        {
-            last = 0;
-            buffer.clear((size_t)bufferSize);
-        }
+    template <typename SampleType>
+    void processMonoBlock(const SampleType *const input, SampleType *const samples, const int numSamples) noexcept
+    {
+        static_assert(std::is_floating_point_v<SampleType>, "the reverb processes float or double samples");
+
+        for (int i = 0; i < numSamples; ++i)
+            inputBuffer[i] = (StorageType)(input[i] * gain);
+
+        const bool withEarlyReflections = processEarlyReflections(numSamples);
 
-        float process(const float input, const float damp, const float feedbackLevel) noexcept
+        if (downsamplingFactor > 1)
         {
-            const float output = buffer[bufferIndex];
-            last = (output * (1.0f - damp)) + (last * damp);
-            JUCE_UNDENORMALISE(last);
+            processMonoDownsampled(input, samples, numSamples);
 
-            float temp = input + (last * feedbackLevel);
-            JUCE_UNDENORMALISE(temp);
-            buffer[bufferIndex] = temp;
-            bufferIndex = (bufferIndex + 1) % bufferSize;
-            return output;
+            if (withEarlyReflections)
+                addEarlyReflections(samples, numSamples);
+
+            return;
         }
 
-    private:
-        HeapBlock<float> buffer;
-        int bufferSize = 0, bufferIndex = 0;
-        float last = 0.0f;
+        processNetwork(numSamples);
 
-        JUCE_DECLARE_NON_COPYABLE(CombFilter)
-    };
+        if (dryGain.isSmoothing() || wetGain1.isSmoothing() || wetGain2.isSmoothing() || diffusionFeedback.isSmoothing())
+        {
+            dryGain.fill(dryBuffer, numSamples);
+            wetGain1.fill(wetBuffer1, numSamples);
+            wetGain2.fill(wetBuffer2, numSamples);
+            diffusionFeedback.fill(weightBuffer, numSamples);
+
+            withDry(FromBuffer{dryBuffer}, [&](auto dryAt)
+                    { mixMono(input, samples, numSamples, dryAt, FromBuffer{wetBuffer1},
+                              FromBuffer{wetBuffer2}, FromBuffer{weightBuffer}); });
+        }
+        else
+        {
+            withDry(Constant{dryGain.getTargetValue()}, [&](auto dryAt)
+                    { mixMono(input, samples, numSamples, dryAt, Constant{wetGain1.getTargetValue()},
+                              Constant{wetGain2.getTargetValue()}, Constant{diffusionFeedback.getTargetValue()}); });
+        }
 
-    //==============================================================================
-    class AllPassFilter
+        if (withEarlyReflections)
+            addEarlyReflections(samples, numSamples);
+    }
+
+    template <typename SampleType, typename Dry, typename Wet1, typename Wet2, typename Weight>
+    void mixMono(const SampleType *const input, SampleType *const samples, const int numSamples,
+                 Dry dryAt, Wet1 wet1At, Wet2 wet2At, Weight weightAt) noexcept
     {
-    public:
-        AllPassFilter() noexcept {}
+        const float foldGain = getMonoFoldGain();
 
-        void setSize(const int size)
+        for (int i = 0; i < numSamples; ++i)
         {
-            if (size != bufferSize)
-            {
-                bufferIndex = 0;
-                buffer.malloc(size);
-                bufferSize = size;
-            }
+            const float combWeight = weightAt(i) * Tunings::combGain;
+            const float diffusionWeight = (1 - weightAt(i)) * Tunings::diffusionGain;
+            StorageType out = 0;
 
-            clear();
+            for (int c = 0; c < numChannels; ++c)
+                out += combBuffer[c][i] * combWeight + diffusionBuffer[c][i] * diffusionWeight;
+
+            // a channel's own and the other channels' reverb all land in the one output
+            const StorageType wet = out * ((wet1At(i) + wet2At(i)) * foldGain);
+
+            if constexpr (std::is_same_v<Dry, NoDry>)
+                samples[i] = (SampleType)wet;
+            else
+                samples[i] = (SampleType)(wet + input[i] * dryAt(i));
         }
+    }
 
-        void clear() noexcept
+    //==============================================================================
+    // The early reflections read the input at the host rate, before it is decimated, and are
+    // added on top of whatever the mix wrote. Their line is fed even while they are silent,
+    // so turning them up never brings back old input.
+    bool processEarlyReflections(const int numSamples) noexcept
+    {
+        earlyReflections.push(inputBuffer, numSamples);
+
+        if (!earlyGain.isSmoothing() && earlyGain.getTargetValue() <= 0.0f)
+            return false;
+
+        earlyReflections.read(earlyBuffer, numSamples);
+        return true;
+    }
+
+    template <typename SampleType>
+    void addEarlyReflections(SampleType *const left, SampleType *const right, const int numSamples) noexcept
+    {
+        withEarlyGain(numSamples, [&](auto gainAt)
+                      {
+                          for (int i = 0; i < numSamples; ++i)
+                          {
+                              const float early = gainAt(i);
+                              left[i] += (SampleType)(earlyBuffer[0][i] * early);
+                              right[i] += (SampleType)(earlyBuffer[1][i] * early);
+                          } });
+    }
+
+    template <typename SampleType>
+    void addEarlyReflections(SampleType *const samples, const int numSamples) noexcept
+    {
+        const float foldGain = getMonoFoldGain();
+
+        withEarlyGain(numSamples, [&](auto gainAt)
+                      {
+                          for (int i = 0; i < numSamples; ++i)
+                          {
+                              StorageType early = 0;
+
+                              for (int c = 0; c < numChannels; ++c)
+                                  early += earlyBuffer[c][i];
+
+                              samples[i] += (SampleType)(early * (gainAt(i) * foldGain));
+                          } });
+    }
+
+    template <typename Add>
+    void withEarlyGain(const int numSamples, Add &&add) noexcept
+    {
+        if (earlyGain.isSmoothing())
         {
-            buffer.clear((size_t)bufferSize);
+            earlyGain.fill(earlyGainBuffer, numSamples);
+            add(FromBuffer{earlyGainBuffer});
         }
-
-        float process(const float input) noexcept
+        else
         {
-            const float bufferedValue = buffer[bufferIndex];
-            float temp = input + (bufferedValue * 0.5f);
-            JUCE_UNDENORMALISE(temp);
-            buffer[bufferIndex] = temp;
-            bufferIndex = (bufferIndex + 1) % bufferSize;
-            return bufferedValue - input;
+            add(Constant{earlyGain.getTargetValue()});
         }
-
-    private:
-        HeapBlock<float> buffer;
-        int bufferSize = 0, bufferIndex = 0;
-
-        JUCE_DECLARE_NON_COPYABLE(AllPassFilter)
-    };
+    }
 
     //==============================================================================
-    enum
+    // With downsampling the network runs on the decimated input in inputBuffer, its comb and
+    // diffusion outputs are blended and interpolated into upsampledBuffer, and the mix reads from there.
+    template <typename SampleType>
+    void processStereoDownsampled(const SampleType *const inLeft, const SampleType *const inRight,
+                                  SampleType *const left, SampleType *const right, const int numSamples) noexcept
     {
-        numCombs = 8,
-        numAllPasses = 4,
-        numChannels = 2,
-        numDiffusionCombs = 16
-    };
+        const int numNetworkSamples = decimateInput(numSamples);
 
-    Parameters parameters;
-    float gain;
+        processNetwork(numNetworkSamples);
+        blendNetworkOutput(numNetworkSamples);
+        upsampleOutput(numNetworkSamples, numChannels);
+
+        if (dryGain.isSmoothing() || wetGain1.isSmoothing() || wetGain2.isSmoothing())
+        {
+            dryGain.fill(dryBuffer, numSamples);
+            wetGain1.fill(wetBuffer1, numSamples);
+            wetGain2.fill(wetBuffer2, numSamples);
 
-    DiffusionFilter diffusion[numChannels][numDiffusionCombs];
+            withDry(FromBuffer{dryBuffer}, [&](auto dryAt)
+                    { mixUpsampledStereo(inLeft, inRight, left, right, numSamples, dryAt,
+                                         FromBuffer{wetBuffer1}, FromBuffer{wetBuffer2}); });
+        }
+        else
+        {
+            withDry(Constant{dryGain.getTargetValue()}, [&](auto dryAt)
+                    { mixUpsampledStereo(inLeft, inRight, left, right, numSamples, dryAt,
+                                         Constant{wetGain1.getTargetValue()}, Constant{wetGain2.getTargetValue()}); });
+        }
 
-    CombFilter comb[numChannels][numCombs];
+        consumeUpsampled(numSamples);
+    }
 
-    AllPassFilter allPass[numChannels][numAllPasses];
+    template <typename SampleType, typename Dry, typename Wet1, typename Wet2>
+    void mixUpsampledStereo(const SampleType *const inLeft, const SampleType *const inRight,
+                            SampleType *const left, SampleType *const right, const int numSamples,
+                            Dry dryAt, Wet1 wet1At, Wet2 wet2At) noexcept
+    {
+        const StorageType *const wetL = upsampledBuffer[0];
+        const StorageType *const wetR = upsampledBuffer[1];
 
-    SmoothedValue<float> damping, feedback, dryGain, wetGain1, wetGain2, diffusionFeedback;
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const float wet1 = wet1At(i), wet2 = wet2At(i);
 
-    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ReverbFX)
-};
+            if constexpr (std::is_same_v<Dry, NoDry>)
+            {
+                left[i] = (SampleType)(wetL[i] * wet1 + wetR[i] * wet2);
+                right[i] = (SampleType)(wetR[i] * wet1 + wetL[i] * wet2);
+            }
+            else
+            {
+                const float dry = dryAt(i);
+                const SampleType dryL = inLeft[i], dryR = inRight[i];
+                left[i] = (SampleType)(wetL[i] * wet1 + wetR[i] * wet2 + dryL * dry);
+                right[i] = (SampleType)(wetR[i] * wet1 + wetL[i] * wet2 + dryR * dry);
+            }
+        }
+    }
+
+    template <typename SampleType>
+    void processMonoDownsampled(const SampleType *const input, SampleType *const samples, const int numSamples) noexcept
+    {
+        const int numNetworkSamples = decimateInput(numSamples);
+
+        processNetwork(numNetworkSamples);
+        blendNetworkOutput(numNetworkSamples);
+
+        // only the sum of the channels is heard, so only that is upsampled
+        for (int c = 1; c < numChannels; ++c)
+            FloatVectorOperations::add(combBuffer[0], combBuffer[c], numNetworkSamples);
+
+        upsampleOutput(numNetworkSamples, 1);
+
+        if (dryGain.isSmoothing() || wetGain1.isSmoothing() || wetGain2.isSmoothing())
+        {
+            dryGain.fill(dryBuffer, numSamples);
+            wetGain1.fill(wetBuffer1, numSamples);
+            wetGain2.fill(wetBuffer2, numSamples);
+
+            withDry(FromBuffer{dryBuffer}, [&](auto dryAt)
+                    { mixUpsampledMono(input, samples, numSamples, dryAt, FromBuffer{wetBuffer1}, FromBuffer{wetBuffer2}); });
+        }
+        else
+        {
+            withDry(Constant{dryGain.getTargetValue()}, [&](auto dryAt)
+                    { mixUpsampledMono(input, samples, numSamples, dryAt,
+                                       Constant{wetGain1.getTargetValue()}, Constant{wetGain2.getTargetValue()}); });
+        }
+
+        consumeUpsampled(numSamples);
+    }
+
+    template <typename SampleType, typename Dry, typename Wet1, typename Wet2>
+    void mixUpsampledMono(const SampleType *const input, SampleType *const samples, const int numSamples,
+                          Dry dryAt, Wet1 wet1At, Wet2 wet2At) noexcept
+    {
+        const float foldGain = getMonoFoldGain();
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const StorageType wet = upsampledBuffer[0][i] * ((wet1At(i) + wet2At(i)) * foldGain);
+
+            if constexpr (std::is_same_v<Dry, NoDry>)
+                samples[i] = (SampleType)wet;
+            else
+                samples[i] = (SampleType)(wet + input[i] * dryAt(i));
+        }
+    }
+
+    /** The channels' tails are uncorrelated, so their sum is scaled to keep the power of one. */
+    static float getMonoFoldGain() noexcept { return 1.0f / std::sqrt((float)numChannels); }
+
+    /** Mixes the diffusion output into combBuffer by the comb weight, which is ramped at the network rate.
+        Blending before interpolating halves the number of channels to upsample.
+    */
+    void blendNetworkOutput(const int numNetworkSamples) noexcept
+    {
+        diffusionFeedback.fill(weightBuffer, numNetworkSamples);
+
+        for (int c = 0; c < numChannels; ++c)
+            for (int i = 0; i < numNetworkSamples; ++i)
+                combBuffer[c][i] = combBuffer[c][i] * (weightBuffer[i] * Tunings::combGain)
+                                 + diffusionBuffer[c][i] * ((1 - weightBuffer[i]) * Tunings::diffusionGain);
+    }
+
+    /** Decimates inputBuffer in place and returns how many network samples it now holds. */
+    int decimateInput(const int numSamples) noexcept
+    {
+        int numDecimated = numSamples;
+
+        if (downsamplingFactor == 4)
+            numDecimated = outerDecimator.process(inputBuffer, inputBuffer, numDecimated);
+
+        return decimator.process(inputBuffer, inputBuffer, numDecimated);
+    }
+
+    /** Interpolates the network output in combBuffer onto the end of upsampledBuffer. */
+    void upsampleOutput(const int numNetworkSamples, const int channelsToUpsample) noexcept
+    {
+        jassert(numUpsampled + downsamplingFactor * numNetworkSamples <= (int)std::size(upsampledBuffer[0]));
+
+        for (int c = 0; c < channelsToUpsample; ++c)
+        {
+            StorageType *const destination = upsampledBuffer[c] + numUpsampled;
+
+            if (downsamplingFactor == 4)
+            {
+                // diffusionBuffer is free by now and holds the intermediate rate
+                interpolators[c].process(combBuffer[c], diffusionBuffer[c], numNetworkSamples);
+                outerInterpolators[c].process(diffusionBuffer[c], destination, 2 * numNetworkSamples);
+            }
+            else
+            {
+                interpolators[c].process(combBuffer[c], destination, numNetworkSamples);
+            }
+        }
+
+        numUpsampled += downsamplingFactor * numNetworkSamples;
+    }
+
+    /** Drops the samples the mix has used, keeping the few that run ahead of the host. */
+    void consumeUpsampled(const int numSamples) noexcept
+    {
+        jassert(numUpsampled >= numSamples);
+        numUpsampled -= numSamples;
+
+        for (auto &channel : upsampledBuffer)
+            for (int i = 0; i < numUpsampled; ++i)
+                channel[i] = channel[numSamples + i];
+    }
+
+    void resetResampling() noexcept
+    {
+        decimator.reset();
+        outerDecimator.reset();
+
+        for (auto &filter : interpolators)
+            filter.reset();
+
+        for (auto &filter : outerInterpolators)
+            filter.reset();
+
+        // the wet signal starts this many samples late, which keeps an output ready for every
+        // input whatever the block sizes; with a group of outputs per first input of a group,
+        // up to twice as many then run ahead of the host
+        numUpsampled = downsamplingFactor - 1;
+
+        for (auto &channel : upsampledBuffer)
+            FloatVectorOperations::clear(channel, numUpsampled);
+    }
+
+    static int getDownsamplingFactor(const double sampleRate) noexcept
+    {
+        int factor = 1;
+
+        while (factor < maximumDownsamplingFactor && sampleRate / (factor * 2) >= minimumNetworkSampleRate)
+            factor *= 2;
+
+        return factor;
+    }
+
+    void processCombs(const int numSamples, const bool modulated) noexcept
+    {
+        auto run = [&](auto dampAt, auto feedbackAt)
+        {
+            if (modulated)
+                combs.process(inputBuffer, dampAt, feedbackAt, combBuffer, numSamples, modulation);
+            else
+                combs.process(inputBuffer, dampAt, feedbackAt, combBuffer, numSamples);
+        };
+
+        if (damping.isSmoothing() || feedback.isSmoothing())
+        {
+            damping.fill(dampingBuffer, numSamples);
+            feedback.fill(feedbackBuffer, numSamples);
+
+            run(FromBuffer{dampingBuffer}, FromBuffer{feedbackBuffer});
+        }
+        else
+        {
+            run(Constant{damping.getTargetValue()}, Constant{feedback.getTargetValue()});
+        }
+    }
+
+    /** Coefficient sources for the kernels: either a per-sample ramp or one value for the whole block. */
+    struct FromBuffer
+    {
+        const float *buffer;
+        float operator()(const int i) const noexcept { return buffer[i]; }
+    };
+
+    struct Constant
+    {
+        float value;
+        float operator()(int) const noexcept { return value; }
+    };
+
+    /** Stands in for the dry gain when wet only, so the mix leaves the dry term out. */
+    struct NoDry
+    {
+    };
+
+    /** Runs a mix with the given dry gain, or with NoDry when wet only. */
+    template <typename Dry, typename Mix>
+    void withDry(Dry dryAt, Mix &&mix) noexcept
+    {
+        if (wetOnly)
+            mix(NoDry{});
+        else
+            mix(dryAt);
+    }
+
+    //==============================================================================
+    /** Works out every delay line length for a sample rate and, if memory is given, points each
+        filter at its slice of it. Returns the number of samples the layout needs.
+    */
+    size_t layoutDelayLines(const double sampleRate, StorageType *const memory)
+    {
+        size_t numSamplesUsed = 0;
+
+        // every line starts on its own cache line, in the order the network visits them
+        auto carve = [memory, &numSamplesUsed](const size_t numSamples) -> StorageType *
+        {
+            StorageType *const start = memory != nullptr ? memory + numSamplesUsed : nullptr;
+            numSamplesUsed += (numSamples + samplesPerCacheLine - 1) & ~(size_t)(samplesPerCacheLine - 1);
+            return start;
+        };
+
+        // the modulated lines need room for their longest delay plus the excursion and the
+        // second sample of the interpolation
+        const int headroom = (int)std::ceil(maximumModulationSeconds * sampleRate) + 1;
+        int combSizes[numChannels][numCombs];
+
+        for (int c = 0; c < numChannels; ++c)
+            for (int i = 0; i < numCombs; ++i)
+                combSizes[c][i] = Tunings::scale(Tunings::combs[i] + c * Tunings::stereoSpread, sampleRate);
+
+        if (auto *combMemory = carve(CombBank::getRequiredSize(combSizes, headroom)))
+            combs.setBuffer(combMemory, combSizes, headroom);
+
+        for (int i = 0; i < numAllPasses; ++i)
+        {
+            int sizes[numChannels];
+
+            for (int c = 0; c < numChannels; ++c)
+                sizes[c] = Tunings::scale(Tunings::allPasses[i] + c * Tunings::stereoSpread, sampleRate);
+
+            if (auto *lineMemory = carve(ChannelDelayLine::getRequiredSize(sizes, 0)))
+                allPass[i].setBuffer(lineMemory, sizes, 0, interleaveChannels);
+        }
+
+        for (int i = 0; i < numDiffusionCombs; ++i)
+        {
+            int sizes[numChannels];
+
+            for (int c = 0; c < numChannels; ++c)
+                sizes[c] = Tunings::scale(Tunings::diffusion[i] + c * Tunings::stereoSpread, sampleRate);
+
+            if (auto *lineMemory = carve(ChannelDelayLine::getRequiredSize(sizes, headroom)))
+                diffusion[i].setBuffer(lineMemory, sizes, headroom, interleaveChannels);
+        }
+
+        return numSamplesUsed;
+    }
+
+    void allocateArena(const size_t numSamples)
+    {
+        arenaStorage.malloc(numSamples + samplesPerCacheLine);
+        arena = snapPointerToAlignment(arenaStorage.get(), samplesPerCacheLine * sizeof(StorageType));
+        arenaSize = numSamples;
+    }
+
+private:
+    //==============================================================================
+    enum
+    {
+        numCombs = (int)std::size(Tunings::combs),
+        numAllPasses = (int)std::size(Tunings::allPasses),
+        numChannels = NumChannels,
+        numDiffusionCombs = (int)std::size(Tunings::diffusion),
+        blockSize = 256,
+        maximumDownsamplingFactor = 4,
+        samplesPerCacheLine = 64 / sizeof(StorageType)
+    };
+
+    static_assert(numChannels > 0 && numCombs > 0 && numAllPasses > 0 && numDiffusionCombs > 0,
+                  "the network needs a channel and at least one filter of each kind");
+    static_assert(std::is_same_v<StorageType, float> || std::is_same_v<StorageType, double>,
+                  "the delay lines hold float or double samples");
+
+    //==============================================================================
+    /** The slow LFOs that move the comb and diffusion delays, one per line.
+
+        Each line's LFO starts at its own phase and runs at a slightly different rate, so the lines
+        never move together. The LFOs are read from a sine table once every interval samples, and
+        the delays hold still in between, so the filters keep their contiguous runs. plan() cuts a
+        block into segments at those ticks, and every stage then reads the same plan.
+    */
+    class DelayModulation
+    {
+    public:
+        static constexpr int interval = 32;
+
+        enum
+        {
+            numLines = numChannels * (numCombs + numDiffusionCombs),
+            maximumSegments = blockSize / interval + 1
+        };
+
+        /** A stretch of the block with constant delays, and each line's offset in samples. */
+        struct Segment
+        {
+            int start = 0, length = 0;
+            float offsets[numLines] = {};
+        };
+
+        DelayModulation() noexcept { reset(); }
+
+        /** The combs come first, lane by lane, then each diffusion filter's channels. */
+        static int getDiffusionLine(const int filter) noexcept { return numChannels * (numCombs + filter); }
+
+        void prepare(const double sampleRate) noexcept
+        {
+            jassert(sampleRate > 0);
+            currentSampleRate = sampleRate;
+            maximumExcursion = (float)(maximumModulationSeconds * sampleRate);
+
+            // the depth takes about 50ms to go all the way
+            depthStep = (float)(interval / (0.05 * sampleRate));
+
+            setTarget(targetDepth, rate);
+            reset();
+        }
+
+        void setTarget(const float newDepth, const float newRate) noexcept
+        {
+            targetDepth = jlimit(0.0f, 1.0f, newDepth);
+            rate = jmax(0.0f, newRate);
+
+            for (int line = 0; line < numLines; ++line)
+            {
+                // rates spread over +-15% around the set one
+                const float spread = 0.85f + 0.3f * (float)line / (float)jmax(1, numLines - 1);
+                increments[line] = (float)(rate * spread * interval / currentSampleRate);
+            }
+        }
+
+        void reset() noexcept
+        {
+            depth = targetDepth;
+            samplesToTick = 0;
+
+            for (int line = 0; line < numLines; ++line)
+            {
+                // a step coprime to the number of lines scatters neighbouring lines round the cycle
+                phases[line] = (float)((line * 7) % numLines) / (float)numLines;
+                current[line] = 0.0f;
+            }
+        }
+
+        bool isActive() const noexcept { return depth > 0.0f || targetDepth > 0.0f; }
+
+        /** Works out the segments of the next numSamples and the offsets of each. */
+        void plan(const int numSamples) noexcept
+        {
+            jassert(numSamples <= blockSize);
+            numSegments = 0;
+
+            for (int start = 0; start < numSamples;)
+            {
+                if (samplesToTick == 0)
+                {
+                    tick();
+                    samplesToTick = interval;
+                }
+
+                auto &segment = segments[numSegments++];
+                segment.start = start;
+                segment.length = jmin(samplesToTick, numSamples - start);
+                std::copy(std::begin(current), std::end(current), segment.offsets);
+
+                samplesToTick -= segment.length;
+                start += segment.length;
+            }
+        }
+
+        int getNumSegments() const noexcept { return numSegments; }
+        const Segment &getSegment(const int index) const noexcept { return segments[index]; }
+
+    private:
+        void tick() noexcept
+        {
+            depth = depth < targetDepth ? jmin(targetDepth, depth + depthStep) : jmax(targetDepth, depth - depthStep);
+            const float amplitude = depth * maximumExcursion;
+
+            for (int line = 0; line < numLines; ++line)
+            {
+                phases[line] += increments[line];
+                phases[line] -= (float)(int)phases[line];
+                current[line] = amplitude * getSine(phases[line]);
+            }
+        }
+
+        /** Reads a sine from the table for a phase in cycles, from 0 to 1. */
+        static float getSine(const float phase) noexcept
+        {
+            const float position = phase * (float)tableSize;
+            const int index = (int)position;
+            const float fraction = position - (float)index;
+            return sineTable[(size_t)index] + (sineTable[(size_t)index + 1] - sineTable[(size_t)index]) * fraction;
+        }
+
+        static constexpr int tableSize = 256;
+
+        static std::array<float, tableSize + 1> makeSineTable() noexcept
+        {
+            std::array<float, tableSize + 1> table;
+
+            for (int i = 0; i <= tableSize; ++i)
+                table[(size_t)i] = (float)std::sin(MathConstants<double>::twoPi * i / tableSize);
+
+            return table;
+        }
+
+        static inline const std::array<float, tableSize + 1> sineTable = makeSineTable();
+
+        Segment segments[maximumSegments];
+        int numSegments = 0, samplesToTick = 0;
+        float phases[numLines], increments[numLines] = {}, current[numLines];
+        float depth = 0, targetDepth = 0, depthStep = 0, rate = 0.5f, maximumExcursion = 0;
+        double currentSampleRate = 44100.0;
+
+        JUCE_DECLARE_NON_COPYABLE(DelayModulation)
+    };
+
+    //==============================================================================
+    /** A delay line per channel, all sharing one write position in a slice of the arena.
+
+        Each channel reads back at its own length. With interleaved channels the samples the
+        channels write at the same moment sit next to each other, so one cache line serves all.
+        A line with headroom can have its delays moved by up to that many samples, less one.
+    */
+    class ChannelDelayLine
+    {
+    public:
+        ChannelDelayLine() noexcept {}
+
+        static size_t getRequiredSize(const int (&sizes)[numChannels], const int headroom) noexcept
+        {
+            int longest = 0;
+
+            for (auto size : sizes)
+                longest = jmax(longest, size);
+
+            return (size_t)(numChannels * (longest + headroom));
+        }
+
+        void setBuffer(StorageType *const memory, const int (&sizes)[numChannels], const int headroom,
+                       const bool interleaved) noexcept
+        {
+            length = 0;
+
+            for (int c = 0; c < numChannels; ++c)
+            {
+                jassert(sizes[c] > headroom);
+                delays[c] = sizes[c];
+                length = jmax(length, sizes[c] + headroom);
+            }
+
+            setModulation(nullptr);
+
+            buffer = memory;
+            frameStride = interleaved ? numChannels : 1;
+            channelStride = interleaved ? 1 : length;
+            writeIndex = 0;
+
+            clear();
+        }
+
+        void clear() noexcept
+        {
+            FloatVectorOperations::clear(buffer, numChannels * length);
+        }
+
+    protected:
+        /** Moves the delay of each channel by the given number of samples, or back to its own
+            length with nullptr. Fractions are read from the sample after, one further back. */
+        void setModulation(const float *const offsets) noexcept
+        {
+            shortest = std::numeric_limits<int>::max();
+
+            for (int c = 0; c < numChannels; ++c)
+            {
+                if (offsets == nullptr)
+                {
+                    readDelays[c] = delays[c];
+                    fractions[c] = 0;
+                }
+                else
+                {
+                    const float delay = (float)delays[c] + offsets[c];
+                    readDelays[c] = (int)delay;
+                    fractions[c] = (StorageType)(delay - (float)readDelays[c]);
+                    jassert(readDelays[c] > 0 && readDelays[c] < length);
+                }
+
+                shortest = jmin(shortest, readDelays[c]);
+            }
+        }
+
+        /** Returns how many samples can be processed before any index wraps. Runs are also kept
+            shorter than every delay, so reads never depend on writes from the same run. */
+        int getRunLength(const int numSamples, const bool modulated = false) const noexcept
+        {
+            int run = jmin(numSamples, length - writeIndex, shortest);
+
+            for (int c = 0; c < numChannels; ++c)
+            {
+                run = jmin(run, length - getReadIndex(c, 0));
+
+                if (modulated)
+                    run = jmin(run, length - getReadIndex(c, 1));
+            }
+
+            return run;
+        }
+
+        /** Points at the channel's delayed samples, or with later 1, at the ones a sample older. */
+        const StorageType *getReadPointer(const int channel, const int later = 0) const noexcept
+        {
+            return buffer + channel * channelStride + getReadIndex(channel, later) * frameStride;
+        }
+
+        StorageType getFraction(const int channel) const noexcept { return fractions[channel]; }
+
+        StorageType *getWritePointer(const int channel) const noexcept
+        {
+            return buffer + channel * channelStride + writeIndex * frameStride;
+        }
+
+        void advance(const int numSamples) noexcept
+        {
+            writeIndex += numSamples;
+
+            if (writeIndex == length)
+                writeIndex = 0;
+        }
+
+        bool isInterleaved() const noexcept { return frameStride != 1; }
+
+    private:
+        int getReadIndex(const int channel, const int later) const noexcept
+        {
+            const int index = writeIndex - readDelays[channel] - later;
+            return index < 0 ? index + length : index;
+        }
+
+        StorageType *buffer = nullptr;
+        int length = 0, shortest = 0, writeIndex = 0;
+        int frameStride = 1, channelStride = 0;
+        int delays[numChannels] = {}, readDelays[numChannels] = {};
+        StorageType fractions[numChannels] = {};
+
+        JUCE_DECLARE_NON_COPYABLE(ChannelDelayLine)
+    };
+
+    //==============================================================================
+    class DiffusionFilter : public ChannelDelayLine
+    {
+    public:
+        DiffusionFilter() noexcept {}
+
+        using ChannelDelayLine::getRunLength, ChannelDelayLine::getReadPointer, ChannelDelayLine::getWritePointer,
+            ChannelDelayLine::advance, ChannelDelayLine::isInterleaved, ChannelDelayLine::setModulation,
+            ChannelDelayLine::getFraction;
+
+        /** Feeds a block of input through every channel and adds their outputs to the output blocks. */
+        void process(const StorageType *const input, const StorageType feedbackLevel,
+                     StorageType (&outputs)[numChannels][blockSize], const int numSamples) noexcept
+        {
+            processRange<false>(input, feedbackLevel, outputs, 0, numSamples);
+        }
+
+        /** The same, with the delays of each segment of the modulation plan, starting at firstLine. */
+        void process(const StorageType *const input, const StorageType feedbackLevel,
+                     StorageType (&outputs)[numChannels][blockSize], const int numSamples,
+                     const DelayModulation &modulation, const int firstLine) noexcept
+        {
+            for (int s = 0; s < modulation.getNumSegments(); ++s)
+            {
+                const auto &segment = modulation.getSegment(s);
+                jassert(segment.start + segment.length <= numSamples);
+
+                setModulation(segment.offsets + firstLine);
+                processRange<true>(input, feedbackLevel, outputs, segment.start, segment.start + segment.length);
+            }
+
+            ignoreUnused(numSamples);
+        }
+
+    private:
+        template <bool modulated>
+        void processRange(const StorageType *const input, const StorageType feedbackLevel,
+                          StorageType (&outputs)[numChannels][blockSize], const int begin, const int end) noexcept
+        {
+            for (int start = begin; start < end;)
+            {
+                const int run = getRunLength(end - start, modulated);
+
+                if (isInterleaved())
+                    processRun<numChannels, modulated>(input + start, feedbackLevel, outputs, start, run);
+                else
+                    processRun<1, modulated>(input + start, feedbackLevel, outputs, start, run);
+
+                advance(run);
+                start += run;
+            }
+        }
+
+        template <int frameStride, bool modulated>
+        void processRun(const StorageType *const input, const StorageType feedbackLevel,
+                        StorageType (&outputs)[numChannels][blockSize], const int offset, const int numSamples) noexcept
+        {
+            if constexpr (modulated)
+            {
+                // the channels are separate lines, so each gets a loop of its own, which vectorises
+                // with the interpolation in it
+                for (int c = 0; c < numChannels; ++c)
+                {
+                    const StorageType *const delayed = getReadPointer(c);
+                    const StorageType *const older = getReadPointer(c, 1);
+                    StorageType *const written = getWritePointer(c);
+                    StorageType *const output = outputs[c] + offset;
+                    const StorageType fraction = getFraction(c);
+
+                    for (int i = 0; i < numSamples; ++i)
+                    {
+                        const StorageType newer = delayed[i * frameStride];
+                        const StorageType out = newer + (older[i * frameStride] - newer) * fraction;
+                        written[i * frameStride] = input[i] + (out * feedbackLevel);
+                        output[i] += out;
+                    }
+                }
+            }
+            else
+            {
+                const StorageType *delayed[numChannels];
+                StorageType *written[numChannels];
+
+                for (int c = 0; c < numChannels; ++c)
+                {
+                    delayed[c] = getReadPointer(c);
+                    written[c] = getWritePointer(c);
+                }
+
+                for (int i = 0; i < numSamples; ++i)
+                {
+                    for (int c = 0; c < numChannels; ++c)
+                    {
+                        const StorageType out = delayed[c][i * frameStride];
+                        written[c][i * frameStride] = input[i] + (out * feedbackLevel);
+                        outputs[c][offset + i] += out;
+                    }
+                }
+            }
+        }
+
+        JUCE_DECLARE_NON_COPYABLE(DiffusionFilter)
+    };
+
+    //==============================================================================
+    /** The comb filters of every channel, processed together with one comb per SIMD lane.
+
+        All combs share one ring of rows in the arena, holding a sample per comb. Every comb writes to the
+        current row and reads back from the row that is its own length behind, so the damping
+        state of the whole bank stays in registers and a sample costs a single vector update.
+    */
+    class CombBank
+    {
+    public:
+        CombBank() noexcept {}
+
+        static size_t getRequiredSize(const int (&sizes)[numChannels][numCombs], const int headroom) noexcept
+        {
+            return (size_t)(getNumRows(sizes, headroom) * numLanes);
+        }
+
+        void setBuffer(StorageType *const memory, const int (&sizes)[numChannels][numCombs], const int headroom) noexcept
+        {
+            for (int j = 0; j < numChannels; ++j)
+            {
+                for (int i = 0; i < numCombs; ++i)
+                {
+                    jassert(sizes[j][i] > headroom);
+                    delays[j * numCombs + i] = sizes[j][i];
+                }
+            }
+
+            jassert(Vec::isSIMDAligned(memory));
+            rows = memory;
+            numRows = getNumRows(sizes, headroom);
+            writeRow = 0;
+
+            clear();
+        }
+
+        void clear() noexcept
+        {
+            for (auto &l : last)
+                l = Vec::expand(0);
+
+            FloatVectorOperations::clear(rows, numRows * numLanes);
+        }
+
+        /** Runs a block through every comb, writing the summed output of each channel.
+            The coefficients are callables returning the damping and feedback for a sample index.
+        */
+        template <typename Damping, typename Feedback>
+        void process(const StorageType *const input, Damping dampAt, Feedback feedbackAt,
+                     StorageType (&outputs)[numChannels][blockSize], const int numSamples) noexcept
+        {
+            processRange<false>(input, dampAt, feedbackAt, outputs, 0, numSamples);
+        }
+
+        /** The same, with the delays of each segment of the modulation plan. The combs are its first lines. */
+        template <typename Damping, typename Feedback>
+        void process(const StorageType *const input, Damping dampAt, Feedback feedbackAt,
+                     StorageType (&outputs)[numChannels][blockSize], const int numSamples,
+                     const DelayModulation &modulation) noexcept
+        {
+            for (int s = 0; s < modulation.getNumSegments(); ++s)
+            {
+                const auto &segment = modulation.getSegment(s);
+                jassert(segment.start + segment.length <= numSamples);
+
+                alignas(Vec::SIMDRegisterSize) StorageType fractions[numLanes];
+
+                for (int lane = 0; lane < numLanes; ++lane)
+                {
+                    const float delay = (float)delays[lane] + segment.offsets[lane];
+                    readDelays[lane] = (int)delay;
+                    fractions[lane] = (StorageType)(delay - (float)readDelays[lane]);
+                    jassert(readDelays[lane] > 0 && readDelays[lane] + 1 < numRows);
+                }
+
+                for (int v = 0; v < numVectors; ++v)
+                    fractionVecs[v] = Vec::fromRawArray(fractions + v * Vec::size());
+
+                processRange<true>(input, dampAt, feedbackAt, outputs, segment.start, segment.start + segment.length);
+            }
+
+            ignoreUnused(numSamples);
+        }
+
+    private:
+        template <bool modulated, typename Damping, typename Feedback>
+        void processRange(const StorageType *const input, Damping dampAt, Feedback feedbackAt,
+                          StorageType (&outputs)[numChannels][blockSize], const int begin, const int end) noexcept
+        {
+            alignas(Vec::SIMDRegisterSize) StorageType taps[numLanes];
+            const int mask = numRows - 1;
+            Vec older[modulated ? numVectors : 1];
+
+            // with the delays constant, the sample one further back is the one the previous
+            // sample read, so only the first of the range has to be fetched
+            if constexpr (modulated)
+            {
+                for (int lane = 0; lane < numLanes; ++lane)
+                    taps[lane] = rows[((writeRow - readDelays[lane] - 1) & mask) * numLanes + lane];
+
+                for (int v = 0; v < numVectors; ++v)
+                    older[v] = Vec::fromRawArray(taps + v * Vec::size());
+            }
+
+            for (int i = begin; i < end; ++i)
+            {
+                if constexpr (modulated)
+                {
+                    for (int lane = 0; lane < numLanes; ++lane)
+                        taps[lane] = rows[((writeRow - readDelays[lane]) & mask) * numLanes + lane];
+
+                    // every lane is interpolated at once
+                    for (int v = 0; v < numVectors; ++v)
+                    {
+                        const Vec newer = Vec::fromRawArray(taps + v * Vec::size());
+                        (newer + (older[v] - newer) * fractionVecs[v]).copyToRawArray(taps + v * Vec::size());
+                        older[v] = newer;
+                    }
+                }
+                else
+                {
+                    for (int lane = 0; lane < numLanes; ++lane)
+                        taps[lane] = rows[((writeRow - delays[lane]) & mask) * numLanes + lane];
+                }
+
+                StorageType *const row = rows + writeRow * numLanes;
+                const StorageType damp = dampAt(i), feedbackLevel = feedbackAt(i);
+                const Vec dampVec = Vec::expand(damp);
+                const Vec oneMinusDamp = Vec::expand(1 - damp);
+                Vec sums[numChannels];
+
+                for (auto &sum : sums)
+                    sum = Vec::expand(0);
+
+                for (int v = 0; v < numVectors; ++v)
+                {
+                    const Vec output = Vec::fromRawArray(taps + v * Vec::size());
+                    last[v] = (output * oneMinusDamp) + (last[v] * dampVec);
+
+                    const Vec temp = last[v] * feedbackLevel + input[i];
+                    temp.copyToRawArray(row + v * Vec::size());
+
+                    sums[v / vectorsPerChannel] += output;
+                }
+
+                for (int c = 0; c < numChannels; ++c)
+                    outputs[c][i] = sums[c].sum();
+                writeRow = (writeRow + 1) & mask;
+            }
+        }
+
+        using Vec = dsp::SIMDRegister<StorageType>;
+
+        enum
+        {
+            numLanes = numChannels * numCombs,
+            numVectors = numLanes / (int)Vec::SIMDNumElements,
+            vectorsPerChannel = numCombs / (int)Vec::SIMDNumElements
+        };
+
+        static_assert(numCombs % Vec::SIMDNumElements == 0, "each channel must fill whole SIMD registers");
+
+        static int getNumRows(const int (&sizes)[numChannels][numCombs], const int headroom) noexcept
+        {
+            int longest = 0;
+
+            for (auto &channelSizes : sizes)
+                for (auto size : channelSizes)
+                    longest = jmax(longest, size);
+
+            return nextPowerOfTwo(longest + headroom);
+        }
+
+        StorageType *rows = nullptr;
+        int numRows = 0, writeRow = 0;
+        int delays[numLanes] = {}, readDelays[numLanes] = {};
+        Vec last[numVectors], fractionVecs[numVectors];
+
+        JUCE_DECLARE_NON_COPYABLE(CombBank)
+    };
+
+    //==============================================================================
+    class AllPassFilter : public ChannelDelayLine
+    {
+    public:
+        AllPassFilter() noexcept {}
+
+        using ChannelDelayLine::getRunLength, ChannelDelayLine::getReadPointer, ChannelDelayLine::getWritePointer,
+            ChannelDelayLine::advance, ChannelDelayLine::isInterleaved;
+
+        /** Filters a block of every channel in place. */
+        void process(StorageType (&channels)[numChannels][blockSize], const int numSamples) noexcept
+        {
+            for (int start = 0; start < numSamples;)
+            {
+                const int run = getRunLength(numSamples - start);
+
+                if (isInterleaved())
+                    processRun<numChannels>(channels, start, run);
+                else
+                    processRun<1>(channels, start, run);
+
+                advance(run);
+                start += run;
+            }
+        }
+
+    private:
+        template <int frameStride>
+        void processRun(StorageType (&channels)[numChannels][blockSize], const int offset, const int numSamples) noexcept
+        {
+            const StorageType *delayed[numChannels];
+            StorageType *written[numChannels];
+
+            for (int c = 0; c < numChannels; ++c)
+            {
+                delayed[c] = getReadPointer(c);
+                written[c] = getWritePointer(c);
+            }
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                for (int c = 0; c < numChannels; ++c)
+                {
+                    const StorageType input = channels[c][offset + i];
+                    const StorageType bufferedValue = delayed[c][i * frameStride];
+                    written[c][i * frameStride] = input + (bufferedValue * StorageType(0.5));
+                    channels[c][offset + i] = bufferedValue - input;
+                }
+            }
+        }
+
+        JUCE_DECLARE_NON_COPYABLE(AllPassFilter)
+    };
+
+    //==============================================================================
+    /** A linear ramp towards a target, like SmoothedValue, but read a whole block at a time. */
+    class BlockSmoothedValue
+    {
+    public:
+        BlockSmoothedValue() noexcept {}
+
+        void reset(const double sampleRate, const double rampLengthInSeconds) noexcept
+        {
+            jassert(sampleRate > 0 && rampLengthInSeconds >= 0);
+            stepsToTarget = (int)std::floor(rampLengthInSeconds * sampleRate);
+            setCurrentAndTargetValue(target);
+        }
+
+        void setCurrentAndTargetValue(const float newValue) noexcept
+        {
+            current = target = newValue;
+            countdown = 0;
+        }
+
+        void setTargetValue(const float newValue) noexcept
+        {
+            if (approximatelyEqual(newValue, target))
+                return;
+
+            if (stepsToTarget <= 0)
+            {
+                setCurrentAndTargetValue(newValue);
+                return;
+            }
+
+            target = newValue;
+            countdown = stepsToTarget;
+            step = (target - current) / (float)countdown;
+        }
+
+        bool isSmoothing() const noexcept { return countdown > 0; }
+        float getTargetValue() const noexcept { return target; }
+
+        /** Writes the next numSamples values of the ramp and moves past them. */
+        void fill(float *const dest, const int numSamples) noexcept
+        {
+            const int numRamped = jmin(numSamples, countdown);
+
+            for (int i = 0; i < numRamped; ++i)
+                dest[i] = current + step * (float)(i + 1);
+
+            countdown -= numRamped;
+
+            if (countdown > 0)
+            {
+                current += step * (float)numRamped;
+                return;
+            }
+
+            // the last step lands exactly on the target, as with SmoothedValue
+            const int firstAtTarget = jmax(0, numRamped - 1);
+            FloatVectorOperations::fill(dest + firstAtTarget, target, numSamples - firstAtTarget);
+            current = target;
+        }
+
+    private:
+        float current = 0, target = 0, step = 0;
+        int countdown = 0, stepsToTarget = 0;
+
+        JUCE_DECLARE_NON_COPYABLE(BlockSmoothedValue)
+    };
+
+    Parameters parameters;
+    float gain;
+
+    HeapBlock<StorageType> arenaStorage;
+    StorageType *arena = nullptr;
+    size_t arenaSize = 0;
+    double currentSampleRate = 44100.0;
+    bool interleaveChannels = false;
+    bool downsampling = false;
+    bool wetOnly = false;
+    bool diffusionResting = false;
+    bool diffusionModulated = false; // the diffusion lines still hold modulated delays
+    int downsamplingFactor = 1;
+
+    DiffusionFilter diffusion[numDiffusionCombs];
+
+    CombBank combs;
+
+    AllPassFilter allPass[numAllPasses];
+
+    BlockSmoothedValue damping, feedback, dryGain, wetGain1, wetGain2, diffusionFeedback, earlyGain;
+    DelayModulation modulation;
+    EarlyReflections<numChannels, StorageType> earlyReflections;
+
+    StorageType inputBuffer[blockSize];
+    float dampingBuffer[blockSize], feedbackBuffer[blockSize];
+    float dryBuffer[blockSize], wetBuffer1[blockSize], wetBuffer2[blockSize], weightBuffer[blockSize];
+    StorageType combBuffer[numChannels][blockSize], diffusionBuffer[numChannels][blockSize];
+    StorageType earlyBuffer[numChannels][blockSize];
+    float earlyGainBuffer[blockSize];
+
+    // the half-band stage next to the network gets the steeper filter, as its transition band
+    // lands just below the network's Nyquist; the outer stage only has to protect that band
+    HalfBandDecimator<12, StorageType> decimator;
+    HalfBandDecimator<6, StorageType> outerDecimator;
+    HalfBandInterpolator<12, StorageType> interpolators[numChannels];
+    HalfBandInterpolator<6, StorageType> outerInterpolators[numChannels];
+    StorageType upsampledBuffer[numChannels][blockSize + 2 * maximumDownsamplingFactor];
+    int numUpsampled = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BasicReverbFX)
+};
+
+/** The stereo reverb the plug-in runs. */
+using ReverbFX = BasicReverbFX<2>;
+
+/** The same network with a single channel, for mono-only hosts and cheaper sends. */
+using MonoReverbFX = BasicReverbFX<1>;
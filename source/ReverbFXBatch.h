@@ -0,0 +1,511 @@
+/*
+  ==============================================================================
+
+   Copyright 2023, 2024 Vitalii Voronkin
+
+   Reverb Project is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Reverb Project is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Simple Reverb. If not, see <http://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "ReverbFX.h"
+
+//==============================================================================
+/**
+    Runs NumLanes independent ReverbFX instances side by side, one instance per SIMD lane.
+
+    Every delay line stores a frame of NumLanes samples per time step, so all instances are
+    advanced by the same vector loads and stores, and throughput grows with the vector width
+    rather than with the number of instances. Each lane has its own Parameters, and lanes can
+    be added, removed or reset without disturbing the others. All lanes share one sample rate.
+
+    The network and its tunings are the same as ReverbFX's stereo path, without its delay
+    modulation or early reflections: modulationDepth and earlyLevel are ignored.
+*/
+template <int NumLanes>
+class ReverbFXBatch
+{
+public:
+    //==============================================================================
+    using Parameters = ReverbFX::Parameters;
+
+    ReverbFXBatch()
+    {
+        setSampleRate(44100.0);
+    }
+
+    static constexpr int getNumLanes() noexcept { return NumLanes; }
+
+    //==============================================================================
+    /** Sets the sample rate of every lane.
+        This allocates the delay memory and clears all lanes, so call it before processing.
+    */
+    void setSampleRate(const double sampleRate)
+    {
+        jassert(sampleRate > 0);
+
+        size_t numFrames = 0;
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            const int spread = ch * Tunings::stereoSpread;
+
+            for (int i = 0; i < numCombs; ++i)
+                numFrames += (size_t)(combs[ch][i].length = Tunings::scale(Tunings::combs[i] + spread, sampleRate));
+
+            for (int i = 0; i < numAllPasses; ++i)
+                numFrames += (size_t)(allPasses[ch][i].length = Tunings::scale(Tunings::allPasses[i] + spread, sampleRate));
+
+            for (int i = 0; i < numDiffusionCombs; ++i)
+                numFrames += (size_t)(diffusion[ch][i].length = Tunings::scale(Tunings::diffusion[i] + spread, sampleRate));
+        }
+
+        storageSize = numFrames * NumLanes;
+        storage.malloc(storageSize + Vec::size());
+
+        float *frames = Vec::getNextSIMDAlignedPtr(storage.get());
+
+        forEachLine([&frames](DelayLine &line)
+                    {
+            line.frames = frames;
+            line.index = 0;
+            frames += line.length * NumLanes; });
+
+        rampLength = (int)std::floor(0.01 * sampleRate);
+        reset();
+    }
+
+    /** Clears the delay memory of every lane. */
+    void reset() noexcept
+    {
+        FloatVectorOperations::clear(Vec::getNextSIMDAlignedPtr(storage.get()), (int)storageSize);
+        FloatVectorOperations::clear(&combState[0][0][0], numChannels * numCombs * NumLanes);
+    }
+
+    /** Returns the number of bytes of delay memory shared by all lanes. */
+    size_t getMemoryFootprint() const noexcept { return storageSize * sizeof(float); }
+
+    //==============================================================================
+    /** Starts an instance in a free lane, with cleared buffers and no parameter ramp.
+        Returns the lane index, or -1 if every lane is already in use.
+    */
+    int addLane(const Parameters &params) noexcept
+    {
+        for (int lane = 0; lane < NumLanes; ++lane)
+        {
+            if (!active[lane])
+            {
+                resetLane(lane);
+                setLaneParameters(lane, params);
+
+                for (int k = 0; k < numCoefficients; ++k)
+                    current[k][lane] = target[k][lane];
+
+                rampSamplesLeft[lane] = 0;
+                active[lane] = true;
+                return lane;
+            }
+        }
+
+        return -1;
+    }
+
+    /** Stops processing a lane. Its buffers are cleared when the lane is reused. */
+    void removeLane(const int lane) noexcept
+    {
+        jassert(isPositiveAndBelow(lane, NumLanes));
+        active[lane] = false;
+    }
+
+    /** Clears one lane's delay memory without touching the other lanes. */
+    void resetLane(const int lane) noexcept
+    {
+        jassert(isPositiveAndBelow(lane, NumLanes));
+
+        forEachLine([lane](DelayLine &line)
+                    {
+            for (int i = 0; i < line.length; ++i)
+                line.frames[i * NumLanes + lane] = 0.0f; });
+
+        for (auto &channelState : combState)
+            for (auto &laneState : channelState)
+                laneState[lane] = 0.0f;
+    }
+
+    /** Changes one lane's parameters. Like ReverbFX, the change is ramped over 10ms. */
+    void setLaneParameters(const int lane, const Parameters &params) noexcept
+    {
+        jassert(isPositiveAndBelow(lane, NumLanes));
+
+        const auto coefficients = ReverbFX::getCoefficients(params);
+        inputGain[lane] = coefficients.inputGain;
+        target[dampingIndex][lane] = coefficients.damping;
+        target[feedbackIndex][lane] = coefficients.feedback;
+        target[dryIndex][lane] = coefficients.dryGain;
+        target[wet1Index][lane] = coefficients.wetGain1;
+        target[wet2Index][lane] = coefficients.wetGain2;
+        target[weightIndex][lane] = coefficients.combWeight;
+
+        startRamp(lane);
+    }
+
+    bool isLaneActive(const int lane) const noexcept { return active[lane]; }
+
+    int getNumActiveLanes() const noexcept
+    {
+        return (int)std::count(std::begin(active), std::end(active), true);
+    }
+
+    //==============================================================================
+    /** Applies every active lane's reverb to its own stereo pair, in place.
+        left and right hold one channel pointer per lane; pointers of inactive lanes are ignored.
+    */
+    void processStereo(float *const *left, float *const *right, const int numSamples) noexcept
+    {
+        jassert(left != nullptr && right != nullptr);
+        const ScopedNoDenormals noDenormals;
+
+        for (int start = 0; start < numSamples; start += blockSize)
+            processBlock(left, right, start, jmin((int)blockSize, numSamples - start));
+    }
+
+private:
+    //==============================================================================
+    using Vec = dsp::SIMDRegister<float>;
+
+    using Tunings = ReverbFX::Tunings;
+
+    enum
+    {
+        numCombs = (int)std::size(Tunings::combs),
+        numAllPasses = (int)std::size(Tunings::allPasses),
+        numChannels = 2,
+        numDiffusionCombs = (int)std::size(Tunings::diffusion),
+        blockSize = 64,
+        numVectors = NumLanes / (int)Vec::SIMDNumElements
+    };
+
+    enum CoefficientIndex
+    {
+        dampingIndex,
+        feedbackIndex,
+        dryIndex,
+        wet1Index,
+        wet2Index,
+        weightIndex,
+        numCoefficients
+    };
+
+    static_assert(NumLanes % Vec::SIMDNumElements == 0, "the lanes must fill whole SIMD registers");
+
+    /** One delay line holding a frame of NumLanes samples per step. */
+    struct DelayLine
+    {
+        float *frames = nullptr;
+        int length = 0, index = 0;
+
+        float *getFrame() const noexcept { return frames + index * NumLanes; }
+
+        /** How many steps can be taken before the index wraps. */
+        int getRunLength(const int numSamples) const noexcept { return jmin(numSamples, length - index); }
+
+        void advance(const int numSamples) noexcept
+        {
+            index += numSamples;
+
+            if (index == length)
+                index = 0;
+        }
+    };
+
+    template <typename Function>
+    void forEachLine(Function &&function)
+    {
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            for (auto &line : combs[ch])
+                function(line);
+
+            for (auto &line : allPasses[ch])
+                function(line);
+
+            for (auto &line : diffusion[ch])
+                function(line);
+        }
+    }
+
+    //==============================================================================
+    /** Starts a lane's ramp from wherever its coefficients are now; the other lanes carry on
+        with their own.
+    */
+    void startRamp(const int lane) noexcept
+    {
+        for (int k = 0; k < numCoefficients; ++k)
+        {
+            // as in ReverbFX, the comb/diffusion weight is not smoothed
+            if (rampLength > 0 && k != weightIndex)
+            {
+                step[k][lane] = (target[k][lane] - current[k][lane]) / (float)rampLength;
+            }
+            else
+            {
+                current[k][lane] = target[k][lane];
+                step[k][lane] = 0.0f;
+            }
+        }
+
+        rampSamplesLeft[lane] = rampLength;
+    }
+
+    /** Points each coefficient at either its constant frame or this block's ramp.
+        Returns the stride to step through them per sample: 0 when constant.
+    */
+    int prepareCoefficients(const int numSamples) noexcept
+    {
+        int numRamped[NumLanes];
+        bool anyRamping = false;
+
+        for (int lane = 0; lane < NumLanes; ++lane)
+        {
+            numRamped[lane] = jmin(numSamples, rampSamplesLeft[lane]);
+            anyRamping = anyRamping || numRamped[lane] > 0;
+        }
+
+        if (!anyRamping)
+        {
+            for (int k = 0; k < numCoefficients; ++k)
+                coefficients[k] = current[k];
+
+            return 0;
+        }
+
+        for (int k = 0; k < numCoefficients; ++k)
+        {
+            float *const ramp = rampBuffers[k];
+
+            for (int i = 0; i < numSamples; ++i)
+                for (int lane = 0; lane < NumLanes; ++lane)
+                    ramp[i * NumLanes + lane] = i < numRamped[lane] ? current[k][lane] + step[k][lane] * (float)(i + 1)
+                                                                    : target[k][lane];
+
+            for (int lane = 0; lane < NumLanes; ++lane)
+                current[k][lane] = numRamped[lane] == rampSamplesLeft[lane] ? target[k][lane]
+                                                                            : current[k][lane] + step[k][lane] * (float)numRamped[lane];
+
+            coefficients[k] = ramp;
+        }
+
+        for (int lane = 0; lane < NumLanes; ++lane)
+            rampSamplesLeft[lane] -= numRamped[lane];
+
+        return NumLanes;
+    }
+
+    //==============================================================================
+    void processBlock(float *const *left, float *const *right, const int offset, const int numSamples) noexcept
+    {
+        const int stride = prepareCoefficients(numSamples);
+
+        for (int lane = 0; lane < NumLanes; ++lane)
+        {
+            for (int i = 0; i < numSamples; ++i)
+                inputFrames[i * NumLanes + lane] = active[lane] ? (left[lane][offset + i] + right[lane][offset + i]) * inputGain[lane]
+                                                                : 0.0f;
+        }
+
+        const int numFloats = numSamples * NumLanes;
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            FloatVectorOperations::clear(combFrames[ch], numFloats);
+            FloatVectorOperations::clear(diffusionFrames[ch], numFloats);
+
+            for (int i = 0; i < numCombs; ++i)
+                processComb(combs[ch][i], combState[ch][i], combFrames[ch], numSamples, stride);
+
+            for (auto &line : allPasses[ch])
+                processAllPass(line, combFrames[ch], numSamples);
+
+            for (auto &line : diffusion[ch])
+                processDiffusion(line, diffusionFrames[ch], numSamples);
+        }
+
+        mix(numSamples, stride);
+
+        for (int lane = 0; lane < NumLanes; ++lane)
+        {
+            if (!active[lane])
+                continue;
+
+            float *const outL = left[lane] + offset;
+            float *const outR = right[lane] + offset;
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const float dry = coefficients[dryIndex][i * stride + lane];
+                outL[i] = combFrames[0][i * NumLanes + lane] + outL[i] * dry;
+                outR[i] = combFrames[1][i * NumLanes + lane] + outR[i] * dry;
+            }
+        }
+    }
+
+    void processComb(DelayLine &line, float *const state, float *const output, const int numSamples, const int stride) noexcept
+    {
+        Vec last[numVectors];
+
+        for (int v = 0; v < numVectors; ++v)
+            last[v] = Vec::fromRawArray(state + v * Vec::size());
+
+        const Vec one = Vec::expand(1.0f);
+
+        for (int start = 0; start < numSamples;)
+        {
+            const int run = line.getRunLength(numSamples - start);
+            float *frame = line.getFrame();
+
+            for (int i = start; i < start + run; ++i, frame += NumLanes)
+            {
+                for (int v = 0; v < numVectors; ++v)
+                {
+                    const int lane = v * (int)Vec::size();
+                    const Vec delayed = Vec::fromRawArray(frame + lane);
+                    const Vec damp = Vec::fromRawArray(coefficients[dampingIndex] + i * stride + lane);
+                    const Vec feedbackLevel = Vec::fromRawArray(coefficients[feedbackIndex] + i * stride + lane);
+
+                    last[v] = (delayed * (one - damp)) + (last[v] * damp);
+                    (Vec::fromRawArray(inputFrames + i * NumLanes + lane) + last[v] * feedbackLevel).copyToRawArray(frame + lane);
+                    (Vec::fromRawArray(output + i * NumLanes + lane) + delayed).copyToRawArray(output + i * NumLanes + lane);
+                }
+            }
+
+            line.advance(run);
+            start += run;
+        }
+
+        for (int v = 0; v < numVectors; ++v)
+            last[v].copyToRawArray(state + v * Vec::size());
+    }
+
+    void processAllPass(DelayLine &line, float *const samples, const int numSamples) noexcept
+    {
+        for (int start = 0; start < numSamples;)
+        {
+            const int run = line.getRunLength(numSamples - start);
+            float *frame = line.getFrame();
+
+            for (int i = start; i < start + run; ++i, frame += NumLanes)
+            {
+                for (int v = 0; v < numVectors; ++v)
+                {
+                    const int lane = v * (int)Vec::size();
+                    float *const sample = samples + i * NumLanes + lane;
+                    const Vec input = Vec::fromRawArray(sample);
+                    const Vec bufferedValue = Vec::fromRawArray(frame + lane);
+
+                    (input + bufferedValue * 0.5f).copyToRawArray(frame + lane);
+                    (bufferedValue - input).copyToRawArray(sample);
+                }
+            }
+
+            line.advance(run);
+            start += run;
+        }
+    }
+
+    void processDiffusion(DelayLine &line, float *const output, const int numSamples) noexcept
+    {
+        const float feedbackLevel = Tunings::diffusionFeedbackLevel;
+
+        for (int start = 0; start < numSamples;)
+        {
+            const int run = line.getRunLength(numSamples - start);
+            float *frame = line.getFrame();
+
+            for (int i = start; i < start + run; ++i, frame += NumLanes)
+            {
+                for (int v = 0; v < numVectors; ++v)
+                {
+                    const int lane = v * (int)Vec::size();
+                    const Vec out = Vec::fromRawArray(frame + lane);
+
+                    (Vec::fromRawArray(inputFrames + i * NumLanes + lane) + out * feedbackLevel).copyToRawArray(frame + lane);
+                    (Vec::fromRawArray(output + i * NumLanes + lane) + out).copyToRawArray(output + i * NumLanes + lane);
+                }
+            }
+
+            line.advance(run);
+            start += run;
+        }
+    }
+
+    /** Weights the comb and diffusion outputs into the wet signal, left in combFrames. */
+    void mix(const int numSamples, const int stride) noexcept
+    {
+        const Vec one = Vec::expand(1.0f);
+        const Vec combGain = Vec::expand(Tunings::combGain);
+        const Vec diffusionGain = Vec::expand(Tunings::diffusionGain);
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            for (int v = 0; v < numVectors; ++v)
+            {
+                const int lane = v * (int)Vec::size();
+                const int index = i * NumLanes + lane;
+                const int coefficientIndex = i * stride + lane;
+
+                const Vec weight = Vec::fromRawArray(coefficients[weightIndex] + coefficientIndex);
+                const Vec combWeight = weight * combGain;
+                const Vec diffusionWeight = (one - weight) * diffusionGain;
+                const Vec wet1 = Vec::fromRawArray(coefficients[wet1Index] + coefficientIndex);
+                const Vec wet2 = Vec::fromRawArray(coefficients[wet2Index] + coefficientIndex);
+
+                const Vec outL = Vec::fromRawArray(combFrames[0] + index) * combWeight + Vec::fromRawArray(diffusionFrames[0] + index) * diffusionWeight;
+                const Vec outR = Vec::fromRawArray(combFrames[1] + index) * combWeight + Vec::fromRawArray(diffusionFrames[1] + index) * diffusionWeight;
+
+                (outL * wet1 + outR * wet2).copyToRawArray(combFrames[0] + index);
+                (outR * wet1 + outL * wet2).copyToRawArray(combFrames[1] + index);
+            }
+        }
+    }
+
+    //==============================================================================
+    HeapBlock<float> storage;
+    size_t storageSize = 0;
+
+    DelayLine combs[numChannels][numCombs];
+    DelayLine allPasses[numChannels][numAllPasses];
+    DelayLine diffusion[numChannels][numDiffusionCombs];
+
+    bool active[NumLanes] = {};
+    float inputGain[NumLanes] = {};
+
+    int rampLength = 0;
+    int rampSamplesLeft[NumLanes] = {}; // each lane ramps on its own, from its last change
+    const float *coefficients[numCoefficients] = {};
+
+    alignas(Vec::SIMDRegisterSize) float combState[numChannels][numCombs][NumLanes] = {};
+    alignas(Vec::SIMDRegisterSize) float current[numCoefficients][NumLanes] = {};
+    alignas(Vec::SIMDRegisterSize) float target[numCoefficients][NumLanes] = {};
+    alignas(Vec::SIMDRegisterSize) float step[numCoefficients][NumLanes] = {};
+
+    alignas(Vec::SIMDRegisterSize) float rampBuffers[numCoefficients][blockSize * NumLanes];
+    alignas(Vec::SIMDRegisterSize) float inputFrames[blockSize * NumLanes];
+    alignas(Vec::SIMDRegisterSize) float combFrames[numChannels][blockSize * NumLanes];
+    alignas(Vec::SIMDRegisterSize) float diffusionFrames[numChannels][blockSize * NumLanes];
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ReverbFXBatch)
+};
@@ -0,0 +1,286 @@
+/*
+  ==============================================================================
+
+   Copyright 2023, 2024 Vitalii Voronkin
+
+   Reverb Project is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Reverb Project is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Simple Reverb. If not, see <http://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "ReverbFX.h"
+
+namespace ParamIDs
+{
+
+    inline constexpr auto size{"size"};
+    inline constexpr auto damp{"damp"};
+    inline constexpr auto width{"width"};
+    inline constexpr auto mix{"mix"};
+    inline constexpr auto freeze{"freeze"};
+    inline constexpr auto diffFeedbck{"diffFeedbck"};
+    inline constexpr auto modDepth{"modDepth"};
+    inline constexpr auto modRate{"modRate"};
+    inline constexpr auto early{"early"};
+    inline constexpr auto engine{"engine"};
+    // inline constexpr auto color{"color"};
+
+    inline constexpr const char *all[]{size, damp, width, mix, freeze, diffFeedbck, modDepth, modRate, early, engine};
+
+}
+
+/** Settings kept as properties of the state tree rather than as parameters. */
+namespace StateIDs
+{
+
+    inline constexpr auto impulseResponse{"impulseResponse"};         // path of the convolution engine's response
+    inline constexpr auto convolutionHeadSize{"convolutionHeadSize"}; // see ConvolutionReverb::setHeadSize
+    inline constexpr auto downsampling{"downsampling"};               // see ReverbFX::setDownsampling
+
+}
+
+//==============================================================================
+/** The reverb engines an instance can run, in the order of the engine parameter's choices. */
+enum class EngineType
+{
+    reverbFX,
+    fdn8,
+    fdn16,
+    fdn32,
+    convolution,
+    juceReverb
+};
+
+inline juce::StringArray getEngineNames()
+{
+    return {"ReverbFX", "FDN 8", "FDN 16", "FDN 32", "Convolution", "juce::Reverb"};
+}
+
+//==============================================================================
+/**
+    The plugin parameters as the user sees them (percent), and how they map onto
+    ReverbFX::Parameters. Shared by the processor and the offline tools so they sound the same.
+*/
+struct PluginParameterValues
+{
+    float size = 50.0f;
+    float damp = 50.0f;
+    float width = 50.0f;
+    float mix = 50.0f;
+    float diffFeedbck = 50.0f;
+    bool freeze = false;
+    EngineType engine = EngineType::reverbFX;
+    float modDepth = 0.0f;
+    float modRate = 0.5f; // Hz
+    float early = 0.0f;
+
+    ReverbFX::Parameters toReverbParameters() const noexcept
+    {
+        ReverbFX::Parameters params;
+        params.roomSize = size * 0.01f;
+        params.damping = damp * 0.01f;
+        params.width = width * 0.01f;
+        params.wetLevel = mix * 0.01f;
+        params.dryLevel = 1.0f - mix * 0.01f;
+        params.freezeMode = freeze ? 1.0f : 0.0f;
+        params.diffusionFeedback = diffFeedbck * 0.01f;
+        params.modulationDepth = modDepth * 0.01f;
+        params.modulationRate = modRate;
+        params.earlyLevel = early * 0.01f;
+        return params;
+    }
+
+    /** Reads the values out of a tree saved by ReverbProjectAudioProcessor::getStateInformation.
+        Parameters missing from the tree keep their defaults.
+    */
+    static PluginParameterValues fromValueTree(const juce::ValueTree &state)
+    {
+        PluginParameterValues values;
+
+        for (const auto &child : state)
+        {
+            const auto id = child.getProperty("id").toString();
+            const auto value = (float)child.getProperty("value", 0.0f);
+
+            if (id == ParamIDs::size)
+                values.size = value;
+            else if (id == ParamIDs::damp)
+                values.damp = value;
+            else if (id == ParamIDs::width)
+                values.width = value;
+            else if (id == ParamIDs::mix)
+                values.mix = value;
+            else if (id == ParamIDs::diffFeedbck)
+                values.diffFeedbck = value;
+            else if (id == ParamIDs::modDepth)
+                values.modDepth = value;
+            else if (id == ParamIDs::modRate)
+                values.modRate = value;
+            else if (id == ParamIDs::early)
+                values.early = value;
+            else if (id == ParamIDs::freeze)
+                values.freeze = value >= 0.5f;
+            else if (id == ParamIDs::engine)
+                values.engine = (EngineType)juce::jlimit(0, getEngineNames().size() - 1, juce::roundToInt(value));
+        }
+
+        return values;
+    }
+};
+
+//==============================================================================
+/** A program the plugin ships with: a name and the parameter values it sets. */
+struct FactoryProgram
+{
+    const char *name;
+    PluginParameterValues values;
+};
+
+/** The plugin's programs, in the order the host lists them. The values are stored ready to use,
+    so switching programs parses nothing and allocates nothing.
+*/
+inline constexpr FactoryProgram factoryPrograms[]{
+    // name, {size, damp, width, mix, diffFeedbck, freeze, engine, modDepth, modRate, early}
+    {"Init", {}},
+    {"Small Room", {25.0f, 60.0f, 60.0f, 25.0f, 60.0f, false, EngineType::reverbFX, 0.0f, 0.5f, 70.0f}},
+    {"Vocal Plate", {55.0f, 35.0f, 80.0f, 30.0f, 40.0f, false, EngineType::reverbFX, 30.0f, 0.8f, 0.0f}},
+    {"Dark Chamber", {60.0f, 85.0f, 50.0f, 35.0f, 70.0f, false, EngineType::reverbFX, 0.0f, 0.5f, 40.0f}},
+    {"Large Hall", {85.0f, 45.0f, 100.0f, 35.0f, 50.0f, false, EngineType::reverbFX, 40.0f, 0.4f, 50.0f}},
+    {"Ambient Wash", {98.0f, 30.0f, 100.0f, 60.0f, 30.0f, false, EngineType::reverbFX, 80.0f, 0.3f, 0.0f}},
+    {"Freeze Pad", {100.0f, 20.0f, 100.0f, 70.0f, 50.0f, true, EngineType::reverbFX, 50.0f, 0.2f, 0.0f}},
+};
+
+inline constexpr int numFactoryPrograms = (int)std::size(factoryPrograms);
+
+//==============================================================================
+/**
+    Everything ReverbProjectAudioProcessor::getStateInformation saves.
+
+    It is written as a fixed-layout little-endian record: a tag, the version, the size of the
+    fixed part, every value at its own offset, and the response path last, as UTF-8. Reading it
+    back is a bounds check and a run of loads. Later versions only append fixed fields, so a
+    reader takes the ones it knows and skips to the path; fields missing from an older record
+    keep their defaults. Data without the tag is read as the ValueTree earlier versions saved.
+*/
+struct PluginState
+{
+    PluginParameterValues values;
+    bool downsampling = false;    // see ReverbFX::setDownsampling
+    int convolutionHeadSize = 0;  // see ConvolutionReverb::setHeadSize, 0 when never set
+    int program = 0;              // index into factoryPrograms
+    juce::String impulseResponse; // path of the convolution engine's response, empty for none
+
+    static constexpr juce::uint32 tag = 0x53425652; // "RVBS"
+    static constexpr int version = 1;
+
+    void write(juce::MemoryBlock &destData) const
+    {
+        juce::MemoryOutputStream stream(destData, false);
+        const auto path = impulseResponse.toUTF8();
+        const auto pathBytes = (int)path.sizeInBytes() - 1;
+
+        stream.writeInt((int)tag);
+        stream.writeInt(version);
+        stream.writeInt(fixedSize);
+
+        stream.writeFloat(values.size);
+        stream.writeFloat(values.damp);
+        stream.writeFloat(values.width);
+        stream.writeFloat(values.mix);
+        stream.writeFloat(values.diffFeedbck);
+        stream.writeFloat(values.modDepth);
+        stream.writeFloat(values.modRate);
+        stream.writeFloat(values.early);
+        stream.writeInt(values.freeze ? 1 : 0);
+        stream.writeInt((int)values.engine);
+        stream.writeInt(downsampling ? 1 : 0);
+        stream.writeInt(convolutionHeadSize);
+        stream.writeInt(program);
+        stream.writeInt(pathBytes);
+
+        jassert(stream.getPosition() == fixedSize);
+        stream.write(path.getAddress(), (size_t)pathBytes);
+    }
+
+    /** Reads a record written by write(), or the ValueTree of an earlier version.
+        Returns false, leaving the state as it was, if the data is neither.
+    */
+    bool read(const void *data, const size_t sizeInBytes)
+    {
+        if (data == nullptr)
+            return false;
+
+        if (sizeInBytes < (size_t)headerSize || juce::ByteOrder::littleEndianInt(data) != tag)
+            return readValueTree(data, sizeInBytes);
+
+        juce::MemoryInputStream stream(data, sizeInBytes, false);
+        stream.skipNextBytes(4);
+
+        const int recordVersion = stream.readInt();
+        const int recordFixedSize = stream.readInt();
+
+        if (recordVersion < 1 || recordFixedSize < fixedSize || (size_t)recordFixedSize > sizeInBytes)
+            return false;
+
+        PluginState state;
+        state.values.size = stream.readFloat();
+        state.values.damp = stream.readFloat();
+        state.values.width = stream.readFloat();
+        state.values.mix = stream.readFloat();
+        state.values.diffFeedbck = stream.readFloat();
+        state.values.modDepth = stream.readFloat();
+        state.values.modRate = stream.readFloat();
+        state.values.early = stream.readFloat();
+        state.values.freeze = stream.readInt() != 0;
+        state.values.engine = (EngineType)juce::jlimit(0, getEngineNames().size() - 1, stream.readInt());
+        state.downsampling = stream.readInt() != 0;
+        state.convolutionHeadSize = stream.readInt();
+        state.program = juce::jlimit(0, numFactoryPrograms - 1, stream.readInt());
+
+        const int pathBytes = stream.readInt();
+
+        if (pathBytes < 0 || (size_t)pathBytes > sizeInBytes - (size_t)recordFixedSize)
+            return false;
+
+        if (pathBytes > 0)
+            state.impulseResponse = juce::String::fromUTF8(static_cast<const char *>(data) + recordFixedSize, pathBytes);
+
+        *this = std::move(state);
+        return true;
+    }
+
+private:
+    static constexpr int headerSize = 12;
+    static constexpr int fixedSize = headerSize + 8 * 4 + 6 * 4;
+
+    bool readValueTree(const void *data, const size_t sizeInBytes)
+    {
+        const auto tree = juce::ValueTree::readFromData(data, sizeInBytes);
+
+        if (!tree.isValid())
+            return false;
+
+        PluginState state;
+        state.values = PluginParameterValues::fromValueTree(tree);
+        state.downsampling = (bool)tree.getProperty(StateIDs::downsampling, false);
+        state.convolutionHeadSize = (int)tree.getProperty(StateIDs::convolutionHeadSize, 0);
+        state.impulseResponse = tree.getProperty(StateIDs::impulseResponse).toString();
+
+        *this = std::move(state);
+        return true;
+    }
+};
@@ -0,0 +1,299 @@
+/*
+  ==============================================================================
+
+   Copyright 2023, 2024 Vitalii Voronkin
+
+   Reverb Project is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Reverb Project is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Simple Reverb. If not, see <http://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "ReverbEngines.h"
+#include "ParameterEvents.h"
+#include "RealtimeGuard.h"
+
+#include <iostream>
+
+//==============================================================================
+/**
+    Drives the engines through scripted sessions and fails if the audio path allocates,
+    frees or locks. Built with REVERB_RT_GUARD=ON, which compiles in the hooks.
+
+    Usage: RealtimeCheck [--blocks=2000] [--seed=1]
+
+    Everything a host would do on the audio thread (parameter changes at random offsets,
+    processing in blocks of random size) runs inside a RealtimeGuard scope, and everything it
+    would do elsewhere (prepareToPlay, loading a response, switching downsampling) runs outside.
+    Prints one CSV line per scenario and exits with an error if any scenario had a violation.
+*/
+namespace
+{
+    using Violation = RealtimeGuard::Violation;
+
+    struct Session
+    {
+        ReverbEngines engines;
+        juce::AudioBuffer<float> buffer;
+        ParameterEventList events;
+        PluginParameterValues lastValues;
+        juce::Random random;
+        int numChannels = 2;
+        bool bypassed = false;
+
+        /** What prepareToPlay does: allowed to allocate. */
+        void prepare(const double sampleRate, const int channels, const int maximumBlockSize)
+        {
+            numChannels = channels;
+            buffer.setSize(numChannels, maximumBlockSize);
+            engines.setSampleRate(sampleRate);
+
+            ReverbEngines::ChannelPosition positions[ReverbEngines::maximumChannels];
+
+            for (int c = 0; c < numChannels; ++c)
+                positions[c] = c == 3 ? ReverbEngines::ChannelPosition::lfe
+                               : c == 2 ? ReverbEngines::ChannelPosition::centre
+                                        : (c % 2 == 0 ? ReverbEngines::ChannelPosition::left : ReverbEngines::ChannelPosition::right);
+
+            engines.setChannelLayout(positions, numChannels);
+        }
+
+        PluginParameterValues randomValues(const bool allowEngineChange)
+        {
+            PluginParameterValues values;
+            values.size = random.nextFloat() * 100.0f;
+            values.damp = random.nextFloat() * 100.0f;
+            values.width = random.nextFloat() * 100.0f;
+            values.mix = random.nextFloat() * 100.0f;
+            values.diffFeedbck = 20.0f + random.nextFloat() * 60.0f;
+            values.modDepth = random.nextBool() ? random.nextFloat() * 100.0f : 0.0f;
+            values.modRate = 0.1f + random.nextFloat() * 2.9f;
+            values.early = random.nextBool() ? random.nextFloat() * 100.0f : 0.0f;
+            values.freeze = random.nextInt(20) == 0;
+            values.engine = allowEngineChange ? (EngineType)random.nextInt(ReverbEngines::numEngines) : engines.getEngine();
+            return values;
+        }
+
+        void apply(const PluginParameterValues &values)
+        {
+            const RealtimeGuard::ScopedRealtime scope("parameter update");
+            engines.setParameters(values.toReverbParameters());
+            engines.setEngine(values.engine);
+        }
+
+        /** What processBlock does: must not allocate or lock. */
+        void processBlock(const int numSamples, const int numChanges, const bool allowEngineChange, const bool silent)
+        {
+            // the events are queued before the scope, as the host's parameter thread would; the
+            // last change is ramped across the block, as the plugin queues a host change
+            for (int i = 1; i < numChanges; ++i)
+                events.add(random.nextInt(numSamples), randomValues(allowEngineChange));
+
+            if (numChanges > 0)
+            {
+                const auto values = randomValues(allowEngineChange);
+                events.addRamp(lastValues, values, numSamples);
+                lastValues = values;
+            }
+
+            for (int c = 0; c < numChannels; ++c)
+                for (int i = 0; i < numSamples; ++i)
+                    buffer.setSample(c, i, silent ? 0.0f : random.nextFloat() * 2.0f - 1.0f);
+
+            const RealtimeGuard::ScopedRealtime scope("processBlock");
+
+            if (bypassed)
+            {
+                for (int i = 0; i < events.size(); ++i)
+                    apply(events[i].values);
+            }
+            else
+            {
+                events.processSubBlocks(
+                    numSamples, [this](const PluginParameterValues &values)
+                    { apply(values); },
+                    [this](const int start, const int length)
+                    { process(start, length); });
+            }
+
+            events.clear();
+        }
+
+        void process(const int start, const int numSamples)
+        {
+            if (numChannels == 1)
+            {
+                const RealtimeGuard::ScopedRealtime scope("processMono");
+                engines.processMono(buffer.getWritePointer(0, start), numSamples);
+            }
+            else if (numChannels == 2)
+            {
+                const RealtimeGuard::ScopedRealtime scope("processStereo");
+                engines.processStereo(buffer.getWritePointer(0, start), buffer.getWritePointer(1, start), numSamples);
+            }
+            else
+            {
+                const RealtimeGuard::ScopedRealtime scope("processMultichannel");
+                float *channels[ReverbEngines::maximumChannels];
+
+                for (int c = 0; c < numChannels; ++c)
+                    channels[c] = buffer.getWritePointer(c, start);
+
+                engines.processMultichannel(channels, numChannels, numSamples);
+            }
+        }
+
+        void run(const int numBlocks, const bool allowEngineChange, const int bypassEvery = 0)
+        {
+            for (int block = 0; block < numBlocks; ++block)
+            {
+                if (bypassEvery > 0 && block % bypassEvery == 0)
+                    bypassed = !bypassed;
+
+                processBlock(1 + random.nextInt(buffer.getNumSamples()), random.nextInt(4), allowEngineChange, false);
+            }
+
+            bypassed = false;
+        }
+    };
+
+    /** A second of decaying noise for the convolution engine, prepared like the processor does. */
+    void loadImpulseResponse(ConvolutionReverb &convolution, const double sampleRate)
+    {
+        juce::AudioBuffer<float> response(2, (int)sampleRate);
+        juce::Random random(0x1e5);
+
+        for (int ch = 0; ch < response.getNumChannels(); ++ch)
+            for (int i = 0; i < response.getNumSamples(); ++i)
+                response.setSample(ch, i, (random.nextFloat() * 2.0f - 1.0f) * std::exp(-6.9f * (float)i / response.getNumSamples()));
+
+        auto ir = convolution.prepareImpulseResponse(response, sampleRate);
+
+        // as in the processor, this happens while the audio thread is kept out
+        if (!convolution.hasHistoryFor(*ir))
+            convolution.allocateHistoryFor(*ir);
+
+        convolution.setImpulseResponse(std::move(ir));
+    }
+
+    struct Scenario
+    {
+        const char *name;
+        std::function<void(Session &, int numBlocks)> run;
+    };
+
+    const Scenario scenarios[]{
+        {"parameter sweep", [](Session &session, const int numBlocks)
+         {
+             session.prepare(48000.0, 2, 2048);
+             session.run(numBlocks, false);
+         }},
+        {"engine switching", [](Session &session, const int numBlocks)
+         {
+             session.prepare(48000.0, 2, 2048);
+             loadImpulseResponse(session.engines.getConvolution(), 48000.0);
+             session.run(numBlocks, true);
+         }},
+        {"response swap", [](Session &session, const int numBlocks)
+         {
+             session.prepare(48000.0, 2, 512);
+             session.apply({50, 50, 50, 50, 50, false, EngineType::convolution});
+
+             for (int block = 0; block < numBlocks; ++block)
+             {
+                 // a new response arrives from the message thread every so often
+                 if (block % 50 == 0)
+                     loadImpulseResponse(session.engines.getConvolution(), 48000.0);
+
+                 session.processBlock(512, 0, false, false);
+             }
+         }},
+        {"sample-rate changes", [](Session &session, const int numBlocks)
+         {
+             for (auto sampleRate : {44100.0, 48000.0, 88200.0, 96000.0, 192000.0})
+             {
+                 for (auto downsample : {false, true})
+                 {
+                     session.engines.setDownsampling(downsample);
+                     session.prepare(sampleRate, 2, 1024);
+                     loadImpulseResponse(session.engines.getConvolution(), sampleRate);
+                     session.run(numBlocks / 10, true);
+                 }
+             }
+         }},
+        {"bypass toggles", [](Session &session, const int numBlocks)
+         {
+             session.prepare(48000.0, 2, 1024);
+             session.run(numBlocks, true, 7);
+         }},
+        {"sleep and wake", [](Session &session, const int numBlocks)
+         {
+             session.prepare(48000.0, 2, 512);
+
+             for (int block = 0; block < numBlocks; ++block)
+                 session.processBlock(512, block % 200 == 0 ? 1 : 0, false, (block / 100) % 2 == 1);
+         }},
+        {"mono", [](Session &session, const int numBlocks)
+         {
+             session.prepare(48000.0, 1, 1024);
+             session.run(numBlocks, true);
+         }},
+        {"7.1.4", [](Session &session, const int numBlocks)
+         {
+             session.prepare(48000.0, 12, 1024);
+             session.run(numBlocks, true);
+         }},
+    };
+}
+
+//==============================================================================
+int main(int argc, char *argv[])
+{
+    const juce::ArgumentList args(argc, argv);
+    const int numBlocks = args.containsOption("--blocks") ? juce::jmax(10, args.getValueForOption("--blocks").getIntValue()) : 2000;
+    const auto seed = args.containsOption("--seed") ? args.getValueForOption("--seed").getLargeIntValue() : 1;
+
+#if !REVERB_RT_GUARD
+    std::cerr << "RealtimeCheck was built without REVERB_RT_GUARD, so it cannot see anything\n";
+    return 1;
+#endif
+
+    if (!RealtimeGuard::canDetectLocks())
+        std::cerr << "locks are only detected with glibc, this run checks allocations only\n";
+
+    bool passed = true;
+    std::cout << "scenario,blocks,allocations,deallocations,locks,firstScope,result\n";
+
+    for (auto &scenario : scenarios)
+    {
+        auto session = std::make_unique<Session>();
+        session->random.setSeed(seed);
+
+        RealtimeGuard::resetCounts();
+        scenario.run(*session, numBlocks);
+
+        const int allocations = RealtimeGuard::getCount(Violation::allocation);
+        const int deallocations = RealtimeGuard::getCount(Violation::deallocation);
+        const int locks = RealtimeGuard::getCount(Violation::lock);
+        const bool ok = allocations == 0 && deallocations == 0 && locks == 0;
+        const auto *scope = RealtimeGuard::getFirstScope();
+
+        std::cout << scenario.name << ',' << numBlocks << ',' << allocations << ',' << deallocations << ','
+                  << locks << ',' << (scope != nullptr ? scope : "") << ',' << (ok ? "ok" : "FAIL") << '\n';
+
+        passed = passed && ok;
+    }
+
+    return passed ? 0 : 1;
+}
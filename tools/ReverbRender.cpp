@@ -0,0 +1,394 @@
+/*
+  ==============================================================================
+
+   Copyright 2023, 2024 Vitalii Voronkin
+
+   Reverb Project is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Reverb Project is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Simple Reverb. If not, see <http://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "ReverbFX.h"
+#include "ReverbState.h"
+#include "ParameterEvents.h"
+
+#include <iostream>
+
+//==============================================================================
+/**
+    Renders WAV/AIFF files through ReverbFX without a plugin host.
+
+    Usage: ReverbRender <input file or directory> <output directory>
+                        [--state=saved.state] [--size=50] [--damp=50] [--width=50] [--mix=50]
+                        [--diffusion=50] [--mod-depth=0] [--mod-rate=0.5] [--early=0] [--freeze]
+                        [--downsample] [--tail-threshold=-96] [--max-tail=30] [--block-size=16384]
+                        [--threads=<num cpus>] [--automate=size@1.5=80,mix@4=20]
+
+    Parameters are given in percent, as in the plugin, or read from a file holding the data
+    written by getStateInformation, except --mod-rate, which is in Hz. --automate changes a
+    parameter (size, damp, width, mix, diffusion, mod-depth or early) to a value at a time in
+    seconds; each change lands on its sample, whatever the block size. --downsample runs the network at
+    44.1/48k for high-rate files, as does a state saved with downsampling on; see
+    ReverbFX::setDownsampling. A directory is rendered file by file on all cores.
+    Each file is followed by its reverb tail until the output stays below the threshold.
+*/
+namespace
+{
+    /** A parameter set to a value at a time, from --automate. */
+    struct AutomationPoint
+    {
+        double seconds = 0;
+        float PluginParameterValues::*parameter = nullptr;
+        float value = 0;
+    };
+
+    struct RenderSettings
+    {
+        PluginParameterValues values;
+        std::vector<AutomationPoint> automation; // sorted by time
+        float tailThresholdDb = -96.0f;
+        double maxTailSeconds = 30.0;
+        int blockSize = 16384;
+        bool downsample = false;
+    };
+
+    struct RenderResult
+    {
+        bool ok = false;
+        juce::String message;
+    };
+
+    std::unique_ptr<juce::AudioFormatReader> createReader(const juce::AudioFormatManager &formats, const juce::File &file)
+    {
+        // Memory-mapped reading lets the OS stream the input without extra copies
+        if (auto *format = formats.findFormatForFileExtension(file.getFileExtension()))
+        {
+            std::unique_ptr<juce::MemoryMappedAudioFormatReader> mapped(format->createMemoryMappedReader(file));
+
+            if (mapped != nullptr && mapped->mapEntireFile())
+                return mapped;
+        }
+
+        return std::unique_ptr<juce::AudioFormatReader>{formats.createReaderFor(file)};
+    }
+
+    std::unique_ptr<juce::AudioFormatWriter> createWriter(const juce::AudioFormatManager &formats, const juce::File &file,
+                                                          const juce::AudioFormatReader &reader)
+    {
+        auto *format = formats.findFormatForFileExtension(file.getFileExtension());
+
+        if (format == nullptr)
+            return {};
+
+        file.deleteFile();
+        auto stream = file.createOutputStream();
+
+        if (stream == nullptr)
+            return {};
+
+        const auto bitDepths = format->getPossibleBitDepths();
+        const int bitsPerSample = bitDepths.contains((int)reader.bitsPerSample) ? (int)reader.bitsPerSample : 24;
+
+        std::unique_ptr<juce::AudioFormatWriter> writer(format->createWriterFor(stream.get(), reader.sampleRate,
+                                                                                reader.numChannels, bitsPerSample, {}, 0));
+
+        if (writer != nullptr)
+            stream.release(); // the writer owns the stream now
+
+        return writer;
+    }
+
+    RenderResult renderFile(const juce::AudioFormatManager &formats, const juce::File &input,
+                            const juce::File &output, const RenderSettings &settings)
+    {
+        const auto startTime = juce::Time::getMillisecondCounterHiRes();
+        auto reader = createReader(formats, input);
+
+        if (reader == nullptr)
+            return {false, "cannot read " + input.getFullPathName()};
+
+        auto writer = createWriter(formats, output, *reader);
+
+        if (writer == nullptr)
+            return {false, "cannot write " + output.getFullPathName()};
+
+        const int numChannels = (int)reader->numChannels;
+        const int blockSize = settings.blockSize;
+
+        // one reverb per channel pair, a mono one for an odd channel out
+        std::vector<std::unique_ptr<ReverbFX>> reverbs;
+
+        for (int ch = 0; ch < numChannels; ch += 2)
+        {
+            auto reverb = std::make_unique<ReverbFX>();
+            reverb->setDownsampling(settings.downsample);
+            reverb->setSampleRate(reader->sampleRate);
+            reverb->setParameters(settings.values.toReverbParameters());
+            reverb->reset();
+            reverbs.push_back(std::move(reverb));
+        }
+
+        juce::ScopedNoDenormals noDenormals;
+        juce::AudioBuffer<float> buffer(numChannels, blockSize);
+
+        auto values = settings.values;
+        auto nextPoint = settings.automation.begin();
+        ParameterEventList events;
+
+        auto applyValues = [&reverbs](const PluginParameterValues &newValues)
+        {
+            for (auto &reverb : reverbs)
+                reverb->setParameters(newValues.toReverbParameters());
+        };
+
+        auto processRange = [&reverbs, &buffer, numChannels](const int start, const int numSamples)
+        {
+            for (int ch = 0; ch < numChannels; ch += 2)
+            {
+                auto &reverb = *reverbs[(size_t)(ch / 2)];
+
+                if (ch + 1 < numChannels)
+                    reverb.processStereo(buffer.getWritePointer(ch, start), buffer.getWritePointer(ch + 1, start), numSamples);
+                else
+                    reverb.processMono(buffer.getWritePointer(ch, start), numSamples);
+            }
+        };
+
+        const auto threshold = juce::Decibels::decibelsToGain(settings.tailThresholdDb);
+        const auto maxTailSamples = (juce::int64)(settings.maxTailSeconds * reader->sampleRate);
+        juce::int64 position = 0, tailSamples = 0;
+
+        for (;;)
+        {
+            const auto numFromFile = (int)juce::jlimit((juce::int64)0, (juce::int64)blockSize, reader->lengthInSamples - position);
+
+            buffer.clear();
+
+            if (numFromFile > 0)
+                reader->read(&buffer, 0, numFromFile, position, true, true);
+
+            // the automation points that fall in this block, each with the values in force from it on
+            for (; nextPoint != settings.automation.end(); ++nextPoint)
+            {
+                const auto sample = (juce::int64)std::llround(nextPoint->seconds * reader->sampleRate);
+
+                if (sample >= position + blockSize)
+                    break;
+
+                values.*(nextPoint->parameter) = nextPoint->value;
+                events.add((int)juce::jmax((juce::int64)0, sample - position), values);
+            }
+
+            events.processSubBlocks(blockSize, applyValues, processRange);
+            events.clear();
+
+            int numToWrite = blockSize;
+
+            if (numFromFile < blockSize)
+            {
+                // past the end of the input, the tail rings out until a whole block is quiet
+                float peak = 0.0f;
+
+                for (int ch = 0; ch < numChannels; ++ch)
+                    peak = juce::jmax(peak, buffer.getMagnitude(ch, numFromFile, blockSize - numFromFile));
+
+                if (numFromFile == 0 && peak < threshold)
+                    break;
+
+                tailSamples += blockSize - numFromFile;
+
+                if (tailSamples >= maxTailSamples)
+                    numToWrite -= (int)(tailSamples - maxTailSamples);
+            }
+
+            if (!writer->writeFromAudioSampleBuffer(buffer, 0, numToWrite))
+                return {false, "write failed for " + output.getFullPathName()};
+
+            position += numToWrite;
+
+            if (numFromFile < blockSize && tailSamples >= maxTailSamples)
+                break;
+        }
+
+        writer.reset();
+
+        const auto seconds = (juce::Time::getMillisecondCounterHiRes() - startTime) * 0.001;
+        const auto audioSeconds = (double)position / reader->sampleRate;
+
+        return {true, input.getFileName() + ": " + juce::String(audioSeconds, 2) + " s rendered in "
+                          + juce::String(seconds, 2) + " s (" + juce::String(audioSeconds / juce::jmax(seconds, 1.0e-6), 1) + "x realtime)"};
+    }
+
+    /** Reads a comma-separated list of parameter@seconds=value into points sorted by time. */
+    bool parseAutomation(const juce::String &text, std::vector<AutomationPoint> &points)
+    {
+        const std::pair<const char *, float PluginParameterValues::*> parameters[] = {
+            {"size", &PluginParameterValues::size},
+            {"damp", &PluginParameterValues::damp},
+            {"width", &PluginParameterValues::width},
+            {"mix", &PluginParameterValues::mix},
+            {"diffusion", &PluginParameterValues::diffFeedbck},
+            {"mod-depth", &PluginParameterValues::modDepth},
+            {"early", &PluginParameterValues::early},
+        };
+
+        for (const auto &item : juce::StringArray::fromTokens(text, ",", {}))
+        {
+            if (!item.contains("@") || !item.contains("="))
+                return false;
+
+            const auto name = item.upToFirstOccurrenceOf("@", false, false).trim();
+            const auto time = item.fromFirstOccurrenceOf("@", false, false).upToFirstOccurrenceOf("=", false, false);
+            const auto value = item.fromFirstOccurrenceOf("=", false, false);
+
+            AutomationPoint point;
+            point.seconds = juce::jmax(0.0, time.getDoubleValue());
+            point.value = juce::jlimit(0.0f, 100.0f, value.getFloatValue());
+
+            for (const auto &[parameterName, member] : parameters)
+                if (name == parameterName)
+                    point.parameter = member;
+
+            if (point.parameter == nullptr)
+                return false;
+
+            points.push_back(point);
+        }
+
+        std::stable_sort(points.begin(), points.end(), [](const auto &a, const auto &b)
+                         { return a.seconds < b.seconds; });
+        return true;
+    }
+
+    bool parseArguments(const juce::ArgumentList &args, RenderSettings &settings, int &numThreads)
+    {
+        if (args.containsOption("--state"))
+        {
+            juce::MemoryBlock data;
+            PluginState state;
+
+            if (!args.getFileForOption("--state").loadFileAsData(data) || !state.read(data.getData(), data.getSize()))
+                return false;
+
+            settings.values = state.values;
+            settings.downsample = state.downsampling;
+        }
+
+        auto readPercent = [&args](const char *option, float &value)
+        {
+            if (args.containsOption(option))
+                value = juce::jlimit(0.0f, 100.0f, args.getValueForOption(option).getFloatValue());
+        };
+
+        readPercent("--size", settings.values.size);
+        readPercent("--damp", settings.values.damp);
+        readPercent("--width", settings.values.width);
+        readPercent("--mix", settings.values.mix);
+        readPercent("--diffusion", settings.values.diffFeedbck);
+        readPercent("--mod-depth", settings.values.modDepth);
+        readPercent("--early", settings.values.early);
+
+        if (args.containsOption("--mod-rate"))
+            settings.values.modRate = juce::jlimit(0.1f, 3.0f, args.getValueForOption("--mod-rate").getFloatValue());
+
+        if (args.containsOption("--freeze"))
+            settings.values.freeze = true;
+
+        if (args.containsOption("--automate") && !parseAutomation(args.getValueForOption("--automate"), settings.automation))
+            return false;
+
+        if (args.containsOption("--downsample"))
+            settings.downsample = true;
+
+        if (args.containsOption("--tail-threshold"))
+            settings.tailThresholdDb = args.getValueForOption("--tail-threshold").getFloatValue();
+
+        if (args.containsOption("--max-tail"))
+            settings.maxTailSeconds = juce::jmax(0.0, args.getValueForOption("--max-tail").getDoubleValue());
+
+        if (args.containsOption("--block-size"))
+            settings.blockSize = juce::jlimit(64, 1 << 20, args.getValueForOption("--block-size").getIntValue());
+
+        if (args.containsOption("--threads"))
+            numThreads = juce::jmax(1, args.getValueForOption("--threads").getIntValue());
+
+        return true;
+    }
+}
+
+//==============================================================================
+int main(int argc, char *argv[])
+{
+    const juce::ArgumentList args(argc, argv);
+
+    if (args.size() < 2)
+    {
+        std::cerr << "usage: ReverbRender <input file or directory> <output directory> [options]\n";
+        return 1;
+    }
+
+    RenderSettings settings;
+    int numThreads = juce::SystemStats::getNumCpus();
+
+    if (!parseArguments(args, settings, numThreads))
+    {
+        std::cerr << "could not read the state file or the automation\n";
+        return 1;
+    }
+
+    const auto input = args[0].resolveAsFile();
+    const auto outputDir = args[1].resolveAsFile();
+
+    juce::Array<juce::File> inputs;
+
+    if (input.isDirectory())
+        inputs = input.findChildFiles(juce::File::findFiles, false, "*.wav;*.aif;*.aiff");
+    else
+        inputs.add(input);
+
+    if (inputs.isEmpty() || !outputDir.createDirectory())
+    {
+        std::cerr << "nothing to render\n";
+        return 1;
+    }
+
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+
+    juce::ThreadPool pool(juce::jmin(numThreads, inputs.size()));
+    juce::CriticalSection outputLock;
+    std::atomic<int> numFailed{0};
+
+    for (const auto &file : inputs)
+    {
+        auto job = [&, file]
+        {
+            const auto result = renderFile(formats, file, outputDir.getChildFile(file.getFileName()), settings);
+
+            if (!result.ok)
+                ++numFailed;
+
+            const juce::ScopedLock sl(outputLock);
+            (result.ok ? std::cout : std::cerr) << result.message << std::endl;
+        };
+
+        pool.addJob(job);
+    }
+
+    while (pool.getNumJobs() > 0)
+        juce::Thread::sleep(20);
+
+    return numFailed > 0 ? 1 : 0;
+}